@@ -0,0 +1,239 @@
+#include <cstdio>
+
+#include <QDir>
+#include <QTimer>
+#include <QEventLoop>
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QStandardPaths>
+#include <QSurfaceFormat>
+#include <QCommandLineParser>
+
+#include "window.h"
+#include "gstpipeline.h"
+#include "metrics.h"
+#include "playbacksurface.h"
+#include "contentserver.h"
+#include "processstats.h"
+#include "syntheticmedia.h"
+
+// Runs the real DisupureiWindow against a local ContentServer with
+// generated media and reports playback figures per scenario and render
+// backend. Rendering goes to the offscreen platform unless QT_QPA_PLATFORM
+// says otherwise (e.g. eglfs on a surfaceless EGL device).
+
+struct Scenario {
+    const char* name;
+    int images;
+    int videos;
+};
+
+static const Scenario _scenarios[] = {
+    {"images", 4, 0},
+    {"videos", 0, 3},
+    {"mixed", 2, 2},
+};
+
+struct Result {
+    qint64 firstFrame = -1;
+    QVector<qint64> gaps;
+    int transitions = 0;
+    int frames = 0;
+    int dropped = 0;
+    double gpuMillis = -1;
+    double cpuPercent = 0;
+    qint64 rss = 0;
+    qint64 peakRss = 0;
+};
+
+struct Options {
+    int seconds;
+    int width;
+    int height;
+    int imageMillis;
+    int videoFrames;
+    int fps;
+    int audioChannels;
+};
+
+static Result runScenario(const Scenario& scenario, const QDir& media, const Options& options) {
+    Result result;
+
+    // every scenario starts with a cold cache, so downloads are part of the measurement
+    QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).removeRecursively();
+
+    ContentServer server;
+    server.listen();
+    for (int i = 0; i < scenario.images; i++) {
+        server.addImage(QString("image-%1").arg(i), media.filePath(QString("image%1.jpg").arg(i)), options.imageMillis);
+    }
+    for (int i = 0; i < scenario.videos; i++) {
+        server.addVideo(QString("video-%1").arg(i), media.filePath(QString("video%1").arg(i)));
+    }
+    server.publish();
+
+    DisupureiWindow window;
+    window.playlist().macAddress("bench");
+    window.playlist().url(server.url());
+    window.resize(options.width, options.height);
+
+    QElapsedTimer clock;
+    qint64 entryStarted = 0;
+    bool waitingForFrame = false;
+    bool playingVideo = false;
+    int entryFrames = 0;
+
+    QObject::connect(&window, &DisupureiWindow::entryStarted, [&](const Entry& entry) {
+        if (playingVideo) {
+            result.dropped += qMax(0, options.videoFrames - entryFrames);
+        }
+
+        playingVideo = entry.type == Playlist::Type::VIDEO;
+        entryFrames = 0;
+        entryStarted = clock.elapsed();
+        waitingForFrame = true;
+        result.transitions++;
+    });
+
+    QObject::connect(&window, &DisupureiWindow::framePresented, [&] {
+        result.frames++;
+        entryFrames++;
+
+        if (waitingForFrame) {
+            waitingForFrame = false;
+            if (result.firstFrame < 0) {
+                result.firstFrame = clock.elapsed();
+            } else {
+                result.gaps.append(clock.elapsed() - entryStarted);
+            }
+        }
+    });
+
+    QTimer sampler;
+    QObject::connect(&sampler, &QTimer::timeout, [&] {
+        result.peakRss = qMax(result.peakRss, ProcessStats::residentBytes());
+    });
+    sampler.start(250);
+
+    // the GPU time histogram is process wide, so only this run's share counts
+    auto& gpuFrames = Metrics::histogram("disupurei_gpu_frame_seconds", "GPU time spent drawing a frame, from timer queries",
+                                         {0.0005, 0.001, 0.002, 0.004, 0.008, 0.016, 0.033});
+    quint64 gpuCountStart = gpuFrames.count();
+    double gpuSumStart = gpuFrames.sum();
+
+    double cpuStart = ProcessStats::cpuSeconds();
+    clock.start();
+    window.show();
+    window.playlist().refreshMetadata();
+
+    QEventLoop loop;
+    QTimer::singleShot(options.seconds * 1000, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    result.cpuPercent = 100.0 * (ProcessStats::cpuSeconds() - cpuStart) / (clock.elapsed() / 1000.0);
+    if (gpuFrames.count() > gpuCountStart) {
+        result.gpuMillis = 1000.0 * (gpuFrames.sum() - gpuSumStart) / (gpuFrames.count() - gpuCountStart);
+    }
+    result.rss = ProcessStats::residentBytes();
+    result.peakRss = qMax(result.peakRss, result.rss);
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QApplication::setApplicationName("disupurei_bench");
+    QApplication::setOrganizationName("Carbonium Development");
+    QApplication app(argc, argv);
+
+    QSurfaceFormat format;
+    format.setDepthBufferSize(24);
+    QSurfaceFormat::setDefaultFormat(format);
+
+    QCommandLineParser parser;
+    QCommandLineOption secondsOption = QCommandLineOption({{"d", "duration"}, "Seconds per scenario", "seconds", "30"});
+    QCommandLineOption scenarioOption = QCommandLineOption({{"s", "scenario"}, "images, videos, mixed or all", "name", "all"});
+    QCommandLineOption sizeOption = QCommandLineOption({{"g", "geometry"}, "Window and media size", "WxH", "1920x1080"});
+    QCommandLineOption backendOption = QCommandLineOption({{"b", "backend"}, "widget, thread, direct or all", "name", "widget"});
+    QCommandLineOption audioOption = QCommandLineOption({{"a", "audio"}, "AAC channels in the videos, 6 for 5.1", "channels", "0"});
+    parser.setApplicationDescription("disupurei_bench - headless playback benchmark");
+    parser.addHelpOption();
+    parser.addOption(secondsOption);
+    parser.addOption(scenarioOption);
+    parser.addOption(sizeOption);
+    parser.addOption(backendOption);
+    parser.addOption(audioOption);
+    parser.process(app);
+
+    QStringList size = parser.value(sizeOption).split('x');
+    Options options;
+    options.seconds = qMax(1, parser.value(secondsOption).toInt());
+    options.width = size.value(0).toInt() > 0 ? size.value(0).toInt() : 1920;
+    options.height = size.value(1).toInt() > 0 ? size.value(1).toInt() : 1080;
+    options.imageMillis = 2000;
+    options.fps = 30;
+    options.videoFrames = 5 * options.fps;
+    options.audioChannels = qBound(0, parser.value(audioOption).toInt(), 8);
+
+    GstreamerPipeline::initGstreamer(false);
+
+    QTemporaryDir mediaDir;
+    QDir media(mediaDir.path());
+    for (int i = 0; i < 4; i++) {
+        SyntheticMedia::image(media.filePath(QString("image%1.jpg").arg(i)), options.width, options.height, i);
+    }
+    for (int i = 0; i < 3; i++) {
+        if (! SyntheticMedia::video(media.filePath(QString("video%1").arg(i)), 1280, 720, options.videoFrames, options.fps, options.audioChannels)) {
+            return 1;
+        }
+    }
+
+    QVector<PlaybackSurface::Backend> backends;
+    QString selectedBackend = parser.value(backendOption);
+    for (auto backend : {PlaybackSurface::Backend::WIDGET, PlaybackSurface::Backend::THREAD, PlaybackSurface::Backend::DIRECT}) {
+        if (selectedBackend == "all" || selectedBackend == PlaybackSurface::backendName(backend)) {
+            backends.append(backend);
+        }
+    }
+    if (backends.isEmpty()) {
+        fprintf(stderr, "Unknown backend %s\n", qPrintable(selectedBackend));
+        return 1;
+    }
+
+    printf("%-8s %-8s %9s %9s %9s %6s %7s %7s %7s %7s %8s %8s\n",
+           "backend", "scenario", "ttff ms", "gap ms", "max gap", "trans", "frames", "dropped", "gpu ms", "cpu %", "rss MB", "peak MB");
+
+    QString selected = parser.value(scenarioOption);
+    for (auto backend : backends) {
+        PlaybackSurface::configure(backend);
+        for (auto& scenario : _scenarios) {
+            if (selected != "all" && selected != scenario.name) {
+                continue;
+            }
+
+            Result result = runScenario(scenario, media, options);
+
+            double meanGap = 0;
+            qint64 maxGap = 0;
+            for (auto gap : result.gaps) {
+                meanGap += gap;
+                maxGap = qMax(maxGap, gap);
+            }
+            if (! result.gaps.isEmpty()) {
+                meanGap /= result.gaps.size();
+            }
+
+            printf("%-8s %-8s %9lld %9.1f %9lld %6d %7d %7d %7.2f %7.1f %8.1f %8.1f\n",
+                   PlaybackSurface::backendName(backend), scenario.name, result.firstFrame, meanGap, maxGap,
+                   result.transitions, result.frames, result.dropped, result.gpuMillis, result.cpuPercent,
+                   result.rss / (1024.0 * 1024.0), result.peakRss / (1024.0 * 1024.0));
+            fflush(stdout);
+        }
+    }
+
+    GstreamerPipeline::shutdownGstreamer();
+    return 0;
+}
@@ -0,0 +1,316 @@
+#include "contentserver.h"
+
+#include <QUrl>
+#include <QDir>
+#include <QFile>
+#include <QTcpSocket>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QDateTime>
+
+#include <memory>
+
+#include <QDebug>
+
+ContentServer::ContentServer(QObject *parent) : QObject(parent) {
+    connect(&_server, &QTcpServer::newConnection, this, &ContentServer::_onNewConnection);
+    connect(&_churnTimer, &QTimer::timeout, this, &ContentServer::_onChurn);
+    connect(&_keepaliveTimer, &QTimer::timeout, this, &ContentServer::_onKeepalive);
+    _keepaliveTimer.start(15000);
+}
+
+bool ContentServer::listen(quint16 port) {
+    return _server.listen(QHostAddress::LocalHost, port);
+}
+
+QString ContentServer::url() const {
+    return QString("http://127.0.0.1:%1").arg(_server.serverPort());
+}
+
+void ContentServer::addImage(const QString &fileId, const QString &path, int durationMillis) {
+    _media.append({fileId, path, "image", durationMillis});
+}
+
+void ContentServer::addVideo(const QString &fileId, const QString &path) {
+    _media.append({fileId, path, "video", 0});
+}
+
+int ContentServer::addDirectory(const QString &path, int imageMillis) {
+    QDir dir(path);
+    int added = 0;
+
+    for (auto& info : dir.entryInfoList(QDir::Files, QDir::Name)) {
+        QString suffix = info.suffix().toLower();
+        if (suffix == "jpg" || suffix == "jpeg" || suffix == "png") {
+            addImage(info.completeBaseName(), info.filePath(), imageMillis);
+        } else {
+            addVideo(info.completeBaseName(), info.filePath());
+        }
+        added++;
+    }
+
+    return added;
+}
+
+void ContentServer::clear() {
+    _media.clear();
+}
+
+void ContentServer::publish() {
+    _published = QDateTime::currentMSecsSinceEpoch();
+    _pushEvent(QString("event: sequence\ndata: %1\n\n").arg(_published).toUtf8());
+}
+
+void ContentServer::latency(int millis) {
+    _latency = qMax(0, millis);
+}
+
+void ContentServer::bandwidth(qint64 bytesPerSecond) {
+    _bandwidth = qMax(Q_INT64_C(0), bytesPerSecond);
+}
+
+void ContentServer::failureRate(double rate) {
+    _failureRate = qBound(0.0, rate, 1.0);
+}
+
+void ContentServer::churn(int millis) {
+    if (millis > 0) {
+        _churnTimer.start(millis);
+    } else {
+        _churnTimer.stop();
+    }
+}
+
+qint64 ContentServer::bytesSent() const {
+    return _bytesSent;
+}
+
+int ContentServer::requests() const {
+    return _requests;
+}
+
+int ContentServer::failures() const {
+    return _failures;
+}
+
+int ContentServer::sequenceRequests() const {
+    return _sequenceRequests;
+}
+
+int ContentServer::eventStreams() const {
+    int streams = 0;
+    for (auto& socket : _eventStreams) {
+        if (socket) {
+            streams++;
+        }
+    }
+    return streams;
+}
+
+QByteArray ContentServer::sequence() const {
+    QJsonArray entries;
+    for (auto& media : _media) {
+        QJsonObject entry;
+        entry["id"] = media.fileId;
+        entry["type"] = media.type;
+        entry["fileId"] = media.fileId;
+        if (media.type == "image") {
+            entry["durationMillis"] = media.durationMillis;
+        } else {
+            entry["transcodingComplete"] = true;
+        }
+        entries.append(entry);
+    }
+
+    QJsonObject sequence;
+    sequence["id"] = "bench";
+    sequence["published"] = (double) _published;
+    sequence["entries"] = entries;
+
+    QJsonObject data;
+    data["sequence"] = sequence;
+
+    QJsonObject root;
+    root["data"] = data;
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+QString ContentServer::mediaPath(const QString &fileId) const {
+    for (auto& media : _media) {
+        if (media.fileId == fileId) {
+            return media.path;
+        }
+    }
+
+    return QString();
+}
+
+void ContentServer::respond(QTcpSocket *socket, const QString &path) {
+    // /api/getSequence/<mac>.json, /api/getImage/<fileId>/<w>/<h>, /api/getVideo/<mac>/<fileId>, /api/events/<mac>
+    QStringList parts = path.section('?', 0, 0).split('/', QString::SkipEmptyParts);
+    if (parts.size() < 3 || parts[0] != "api") {
+        send(socket, 404, "text/plain", "not found");
+        return;
+    }
+
+    if (parts[1] == "events") {
+        _openEventStream(socket);
+        return;
+    }
+
+    if (parts[1] == "getSequence") {
+        _sequenceRequests++;
+        send(socket, 200, "application/json", sequence());
+        return;
+    }
+
+    QString fileId;
+    if (parts[1] == "getImage") {
+        fileId = parts[2];
+    } else if (parts[1] == "getVideo" && parts.size() >= 4) {
+        fileId = parts[3];
+    }
+
+    QFile file(mediaPath(fileId));
+    if (fileId.isEmpty() || ! file.open(QIODevice::ReadOnly)) {
+        send(socket, 404, "text/plain", "not found");
+        return;
+    }
+
+    send(socket, 200, "application/octet-stream", file.readAll());
+}
+
+void ContentServer::send(QTcpSocket *socket, int status, const QByteArray &contentType, const QByteArray &body) {
+    QByteArray header = QString("HTTP/1.1 %1 %2\r\n"
+                                "Content-Type: %3\r\n"
+                                "Content-Length: %4\r\n"
+                                "Connection: close\r\n\r\n")
+            .arg(status)
+            .arg(status == 200 ? "OK" : "Error")
+            .arg(QString(contentType))
+            .arg(body.size()).toUtf8();
+
+    _write(socket, header + body);
+}
+
+void ContentServer::_write(QTcpSocket *socket, const QByteArray &data) {
+    if (_bandwidth <= 0) {
+        socket->write(data);
+        socket->disconnectFromHost();
+        _bytesSent += data.size();
+        return;
+    }
+
+    // trickle the response out in 100 ms slices, the timer dies with the socket
+    QTimer* timer = new QTimer(socket);
+    std::shared_ptr<int> offset = std::make_shared<int>(0);
+    connect(timer, &QTimer::timeout, socket, [this, socket, timer, data, offset] {
+        int chunk = (int) qMax(Q_INT64_C(1), _bandwidth / 10);
+        QByteArray slice = data.mid(*offset, chunk);
+        socket->write(slice);
+        _bytesSent += slice.size();
+        *offset += slice.size();
+
+        if (*offset >= data.size()) {
+            timer->stop();
+            socket->disconnectFromHost();
+        }
+    });
+    timer->start(100);
+}
+
+// the response never ends, the stream is closed by the client or with the server
+void ContentServer::_openEventStream(QTcpSocket *socket) {
+    QByteArray header = "HTTP/1.1 200 OK\r\n"
+                        "Content-Type: text/event-stream\r\n"
+                        "Cache-Control: no-cache\r\n"
+                        "Connection: keep-alive\r\n\r\n"
+                        ": connected\n\n";
+    socket->write(header);
+    _bytesSent += header.size();
+    _eventStreams.append(socket);
+}
+
+void ContentServer::_pushEvent(const QByteArray &event) {
+    for (auto it = _eventStreams.begin(); it != _eventStreams.end();) {
+        if (*it) {
+            (*it)->write(event);
+            _bytesSent += event.size();
+            ++it;
+        } else {
+            it = _eventStreams.erase(it);
+        }
+    }
+}
+
+void ContentServer::_onKeepalive() {
+    _pushEvent(": keepalive\n\n");
+}
+
+void ContentServer::_onNewConnection() {
+    while (_server.hasPendingConnections()) {
+        QTcpSocket* socket = _server.nextPendingConnection();
+        connect(socket, &QTcpSocket::readyRead, this, &ContentServer::_onReadyRead);
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+void ContentServer::_onReadyRead() {
+    auto socket = qobject_cast<QTcpSocket*>(sender());
+    if (! socket->canReadLine() || socket->property("handled").toBool()) {
+        return;
+    }
+
+    // GET <path> HTTP/1.1, headers are not needed
+    QList<QByteArray> request = socket->readLine().trimmed().split(' ');
+    socket->readAll();
+    socket->setProperty("handled", true);
+    _requests++;
+
+    if (request.size() < 2 || request[0] != "GET") {
+        send(socket, 405, "text/plain", "method not allowed");
+        return;
+    }
+
+    QString path = QUrl::fromPercentEncoding(request[1]);
+    if (_latency > 0) {
+        QPointer<QTcpSocket> guarded(socket);
+        QTimer::singleShot(_latency, this, [this, guarded, path] {
+            if (guarded) {
+                _handle(guarded, path);
+            }
+        });
+    } else {
+        _handle(socket, path);
+    }
+}
+
+void ContentServer::_handle(QTcpSocket *socket, const QString &path) {
+    if (_failureRate > 0 && qrand() < _failureRate * RAND_MAX) {
+        _failures++;
+
+        // alternate between a server error and a connection dropped mid-request
+        if (_failures % 2) {
+            send(socket, 503, "text/plain", "injected failure");
+        } else {
+            socket->abort();
+        }
+        return;
+    }
+
+    respond(socket, path);
+}
+
+void ContentServer::_onChurn() {
+    if (_media.isEmpty()) {
+        return;
+    }
+
+    // rotate the sequence and give one entry a new file id, so every churn
+    // costs clients one reordering and one download
+    _media.append(_media.takeFirst());
+    Media& renamed = _media.first();
+    renamed.fileId = QString("%1~%2").arg(renamed.fileId.section('~', 0, 0)).arg(++_generation);
+
+    publish();
+}
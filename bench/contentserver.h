@@ -0,0 +1,87 @@
+#ifndef CONTENTSERVER_H
+#define CONTENTSERVER_H
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QVector>
+#include <QTimer>
+#include <QTcpServer>
+#include <QJsonArray>
+
+class QTcpSocket;
+
+// Stand-in for the info screen server. Serves getSequence, getImage and
+// getVideo for a single sequence built from local files, optionally with
+// added latency, a per-connection bandwidth cap, injected failures and a
+// sequence that keeps changing (churn). Every publish is pushed to the
+// open events streams.
+class ContentServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ContentServer(QObject *parent = 0);
+
+    bool listen(quint16 port = 0);
+    QString url() const;
+
+    void addImage(const QString& fileId, const QString& path, int durationMillis);
+    void addVideo(const QString& fileId, const QString& path);
+    int addDirectory(const QString& path, int imageMillis);
+    void clear();
+    void publish();
+
+    void latency(int millis);
+    void bandwidth(qint64 bytesPerSecond);
+    void failureRate(double rate);
+    void churn(int millis);
+
+    qint64 bytesSent() const;
+    int requests() const;
+    int failures() const;
+    int sequenceRequests() const;
+    int eventStreams() const;
+
+protected:
+    virtual void respond(QTcpSocket* socket, const QString& path);
+    void send(QTcpSocket* socket, int status, const QByteArray& contentType, const QByteArray& body);
+    QByteArray sequence() const;
+    QString mediaPath(const QString& fileId) const;
+
+private:
+    struct Media {
+        QString fileId;
+        QString path;
+        QString type;
+        int durationMillis;
+    };
+
+    QTcpServer _server;
+    QTimer _churnTimer;
+    QTimer _keepaliveTimer;
+    QVector<QPointer<QTcpSocket>> _eventStreams;
+    QVector<Media> _media;
+    qint64 _published = 0;
+    qint64 _bytesSent = 0;
+    int _requests = 0;
+    int _failures = 0;
+    int _sequenceRequests = 0;
+    int _generation = 0;
+
+    int _latency = 0;
+    qint64 _bandwidth = 0;
+    double _failureRate = 0;
+
+    void _handle(QTcpSocket* socket, const QString& path);
+    void _write(QTcpSocket* socket, const QByteArray& data);
+    void _openEventStream(QTcpSocket* socket);
+    void _pushEvent(const QByteArray& event);
+
+private slots:
+    void _onNewConnection();
+    void _onReadyRead();
+    void _onChurn();
+    void _onKeepalive();
+};
+
+#endif // CONTENTSERVER_H
@@ -0,0 +1,73 @@
+#include <iostream>
+
+#include <QDir>
+#include <QGuiApplication>
+#include <QTemporaryDir>
+#include <QCommandLineParser>
+
+#include <gst/gst.h>
+
+#include "contentserver.h"
+#include "syntheticmedia.h"
+
+// ContentServer as a standalone process, for pointing real players or
+// disupurei_playlist_soak --url at it.
+
+int main(int argc, char *argv[]) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    gst_init(&argc, &argv);
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    QCommandLineOption portOption = QCommandLineOption({{"p", "port"}, "Port to listen on (loopback only)", "port", "8080"});
+    QCommandLineOption mediaOption = QCommandLineOption({{"m", "media"}, "Serve the files in this directory", "dir"});
+    QCommandLineOption imagesOption = QCommandLineOption({{"i", "images"}, "Generated images when no media dir is given", "count", "4"});
+    QCommandLineOption videosOption = QCommandLineOption({{"v", "videos"}, "Generated videos when no media dir is given", "count", "2"});
+    QCommandLineOption latencyOption = QCommandLineOption({{"l", "latency"}, "Delay before every response", "ms", "0"});
+    QCommandLineOption bandwidthOption = QCommandLineOption({{"b", "bandwidth"}, "Per-connection cap, 0 for none", "KiB/s", "0"});
+    QCommandLineOption failureOption = QCommandLineOption({{"f", "failure-rate"}, "Fraction of requests that fail", "rate", "0"});
+    QCommandLineOption churnOption = QCommandLineOption({{"c", "churn"}, "Republish a changed sequence this often, 0 for never", "ms", "0"});
+    parser.setApplicationDescription("disupurei_mockserver - local stand-in content server");
+    parser.addHelpOption();
+    parser.addOption(portOption);
+    parser.addOption(mediaOption);
+    parser.addOption(imagesOption);
+    parser.addOption(videosOption);
+    parser.addOption(latencyOption);
+    parser.addOption(bandwidthOption);
+    parser.addOption(failureOption);
+    parser.addOption(churnOption);
+    parser.process(app);
+
+    QTemporaryDir generated;
+    QString media = parser.value(mediaOption);
+    if (media.isEmpty()) {
+        media = generated.path();
+        if (! SyntheticMedia::generate(media, parser.value(imagesOption).toInt(), parser.value(videosOption).toInt(), 1280, 720, 150)) {
+            return 1;
+        }
+    }
+
+    ContentServer server;
+    if (server.addDirectory(media, 10000) == 0) {
+        std::cerr << "No media in " << qPrintable(media) << std::endl;
+        return 1;
+    }
+
+    server.latency(parser.value(latencyOption).toInt());
+    server.bandwidth(parser.value(bandwidthOption).toLongLong() * 1024);
+    server.failureRate(parser.value(failureOption).toDouble());
+    server.churn(parser.value(churnOption).toInt());
+    server.publish();
+
+    if (! server.listen(parser.value(portOption).toUShort())) {
+        std::cerr << "Failed to listen on port " << qPrintable(parser.value(portOption)) << std::endl;
+        return 1;
+    }
+
+    std::cout << "Serving " << qPrintable(media) << " at " << qPrintable(server.url()) << std::endl;
+    return app.exec();
+}
@@ -0,0 +1,169 @@
+#include <cstdio>
+
+#include <QDir>
+#include <QTimer>
+#include <QThread>
+#include <QEventLoop>
+#include <QApplication>
+#include <QTemporaryDir>
+#include <QSurfaceFormat>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QCommandLineParser>
+
+#include "videoplayer.h"
+#include "gstpipeline.h"
+#include "processstats.h"
+#include "syntheticmedia.h"
+
+// Cycles a VideoPlayer through open / EOS / stop on short generated clips
+// and fails when memory, GL names or GStreamer objects keep growing after
+// warm-up. Build with CMAKE_BUILD_TYPE=ASan to have LSan report the
+// allocation sites of anything left at exit.
+
+// GL hands out the lowest free name, so a probe name that keeps climbing
+// means textures or buffers are created per iteration and never deleted
+static GLuint probeTextureName(VideoPlayer& player) {
+    player.makeCurrent();
+    QOpenGLFunctions* functions = QOpenGLContext::currentContext()->functions();
+    GLuint name = 0;
+    functions->glGenTextures(1, &name);
+    functions->glDeleteTextures(1, &name);
+    player.doneCurrent();
+    return name;
+}
+
+int main(int argc, char *argv[]) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QApplication::setApplicationName("disupurei_pipeline_soak");
+    QApplication::setOrganizationName("Carbonium Development");
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    QCommandLineOption iterationsOption = QCommandLineOption({{"n", "iterations"}, "Open/EOS/stop cycles", "count", "2000"});
+    QCommandLineOption warmupOption = QCommandLineOption({{"w", "warmup"}, "Cycles before the baseline is taken", "count", "50"});
+    QCommandLineOption clipsOption = QCommandLineOption({{"c", "clips"}, "Distinct clips to rotate through", "count", "3"});
+    QCommandLineOption framesOption = QCommandLineOption({{"f", "frames"}, "Frames per clip", "count", "15"});
+    QCommandLineOption reportOption = QCommandLineOption({{"r", "report"}, "Print a line every n cycles", "count", "100"});
+    QCommandLineOption growthOption = QCommandLineOption({{"g", "max-growth"}, "Allowed RSS growth after warm-up", "MiB", "16"});
+    QCommandLineOption namesOption = QCommandLineOption({"max-gl-names", "Allowed growth of the probed GL texture name after warm-up", "count", "16"});
+    QCommandLineOption timeoutOption = QCommandLineOption({{"t", "timeout"}, "Fail a cycle that doesn't reach EOS in time", "seconds", "10"});
+    parser.setApplicationDescription("disupurei_pipeline_soak - pipeline open/close leak test");
+    parser.addHelpOption();
+    for (auto option : {iterationsOption, warmupOption, clipsOption, framesOption, reportOption,
+                        growthOption, namesOption, timeoutOption}) {
+        parser.addOption(option);
+    }
+    parser.process(app);
+
+    int iterations = qMax(1, parser.value(iterationsOption).toInt());
+    int warmup = qBound(0, parser.value(warmupOption).toInt(), iterations - 1);
+    int reportEvery = qMax(1, parser.value(reportOption).toInt());
+    int timeout = qMax(1, parser.value(timeoutOption).toInt()) * 1000;
+
+    QSurfaceFormat format;
+    format.setDepthBufferSize(24);
+    QSurfaceFormat::setDefaultFormat(format);
+
+    GstreamerPipeline::initGstreamer(false);
+
+    QTemporaryDir mediaDir;
+    QDir media(mediaDir.path());
+    QStringList clips;
+    for (int i = 0; i < qMax(1, parser.value(clipsOption).toInt()); i++) {
+        // different sizes so caps renegotiation and pool reallocation are exercised too
+        QString clip = media.filePath(QString("clip%1").arg(i));
+        if (! SyntheticMedia::video(clip, 320 + 64 * i, 240 + 48 * i, qMax(1, parser.value(framesOption).toInt()), 30)) {
+            return 1;
+        }
+        clips.append(clip);
+    }
+
+    VideoPlayer player;
+    player.resize(640, 480);
+    player.show();
+    while (! player.isValid()) {
+        app.processEvents(QEventLoop::WaitForMoreEvents);
+    }
+    player.initPipeline();
+
+    QEventLoop loop;
+    QTimer deadline;
+    deadline.setSingleShot(true);
+    QObject::connect(&player, &VideoPlayer::finished, &loop, &QEventLoop::quit);
+    QObject::connect(&deadline, &QTimer::timeout, &loop, &QEventLoop::quit);
+
+    qint64 baseRss = 0;
+    GLuint baseName = 0;
+    int timeouts = 0;
+
+    printf("%9s %9s %10s %8s %9s %6s %8s\n", "iteration", "rss MB", "growth MB", "gl name", "pipelines", "stray", "timeouts");
+
+    for (int i = 0; i < iterations; i++) {
+        deadline.start(timeout);
+        player.open(clips.at(i % clips.size()));
+        loop.exec();
+
+        if (! deadline.isActive()) {
+            timeouts++;
+            qWarning() << "Iteration" << i << "didn't reach EOS";
+        }
+        deadline.stop();
+        player.stop();
+
+        // let queued deletes and finalizers run before sampling
+        app.processEvents();
+
+        qint64 rss = ProcessStats::residentBytes();
+        GLuint name = probeTextureName(player);
+        if (i == warmup) {
+            baseRss = rss;
+            baseName = name;
+        }
+
+        if ((i + 1) % reportEvery == 0 || i + 1 == iterations) {
+            printf("%9d %9.1f %10.1f %8u %9d %6d %8d\n",
+                   i + 1, rss / (1024.0 * 1024.0),
+                   i >= warmup ? (rss - baseRss) / (1024.0 * 1024.0) : 0.0,
+                   name, GstreamerPipeline::livePipelines(), GstreamerPipeline::strayReferences(), timeouts);
+            fflush(stdout);
+        }
+    }
+
+    // pipelines are torn down off the pipeline thread, give the last one time to go
+    player.stop();
+    for (int i = 0; i < 40 && GstreamerPipeline::livePipelines() > 0; i++) {
+        QThread::msleep(50);
+        app.processEvents();
+    }
+
+    qint64 rssGrowth = ProcessStats::residentBytes() - baseRss;
+    int nameGrowth = (int) probeTextureName(player) - (int) baseName;
+
+    QStringList failures;
+    if (rssGrowth > parser.value(growthOption).toLongLong() * 1024 * 1024) {
+        failures << QString("RSS grew %1 MB").arg(rssGrowth / (1024.0 * 1024.0), 0, 'f', 1);
+    }
+    if (nameGrowth > parser.value(namesOption).toInt()) {
+        failures << QString("GL texture names grew by %1").arg(nameGrowth);
+    }
+    if (GstreamerPipeline::livePipelines() > 0) {
+        failures << QString("%1 pipelines not finalized").arg(GstreamerPipeline::livePipelines());
+    }
+    if (GstreamerPipeline::strayReferences() > 0) {
+        failures << QString("%1 pipelines released with stray references").arg(GstreamerPipeline::strayReferences());
+    }
+    if (timeouts > 0) {
+        failures << QString("%1 iterations timed out").arg(timeouts);
+    }
+
+    GstreamerPipeline::shutdownGstreamer();
+
+    for (auto& failure : failures) {
+        printf("FAIL: %s\n", qPrintable(failure));
+    }
+    return failures.isEmpty() ? 0 : 1;
+}
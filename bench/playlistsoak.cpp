@@ -0,0 +1,161 @@
+#include <cstdio>
+
+#include <QDir>
+#include <QTimer>
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QCommandLineParser>
+
+#include <gst/gst.h>
+
+#include <memory>
+#include <vector>
+
+#include "metrics.h"
+#include "playlist.h"
+#include "contentserver.h"
+#include "processstats.h"
+#include "syntheticmedia.h"
+
+// Drives many Playlist instances, each with its own identity and cache,
+// through a ContentServer (in-process unless --url is given) and reports
+// download throughput, memory growth and refresh overhead over time. The
+// rates come from the players' own metrics, so they hold for an external
+// server too.
+
+int main(int argc, char *argv[]) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    gst_init(&argc, &argv);
+    QApplication::setApplicationName("disupurei_playlist_soak");
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    QCommandLineOption instancesOption = QCommandLineOption({{"n", "instances"}, "Simulated players", "count", "200"});
+    QCommandLineOption durationOption = QCommandLineOption({{"d", "duration"}, "Run time", "seconds", "600"});
+    QCommandLineOption refreshOption = QCommandLineOption({{"r", "refresh"}, "Metadata refresh interval per player", "ms", "1000"});
+    QCommandLineOption reportOption = QCommandLineOption({"report", "Report interval", "seconds", "10"});
+    QCommandLineOption urlOption = QCommandLineOption({{"u", "url"}, "Use an external server instead of the in-process one", "url"});
+    QCommandLineOption latencyOption = QCommandLineOption({{"l", "latency"}, "In-process server response delay", "ms", "0"});
+    QCommandLineOption bandwidthOption = QCommandLineOption({{"b", "bandwidth"}, "In-process server per-connection cap", "KiB/s", "0"});
+    QCommandLineOption failureOption = QCommandLineOption({{"f", "failure-rate"}, "In-process server failure fraction", "rate", "0"});
+    QCommandLineOption churnOption = QCommandLineOption({{"c", "churn"}, "In-process server sequence churn", "ms", "5000"});
+    QCommandLineOption pushOption = QCommandLineOption({{"p", "push"}, "Listen for pushed changes and poll only this often, 0 to poll at --refresh", "ms", "0"});
+    QCommandLineOption growthOption = QCommandLineOption({{"g", "max-growth"}, "Fail when RSS grows more than this after warm-up, 0 to only report", "MiB", "0"});
+    parser.setApplicationDescription("disupurei_playlist_soak - Playlist load and soak test");
+    parser.addHelpOption();
+    for (auto option : {instancesOption, durationOption, refreshOption, reportOption, urlOption,
+                        latencyOption, bandwidthOption, failureOption, churnOption, pushOption, growthOption}) {
+        parser.addOption(option);
+    }
+    parser.process(app);
+
+    QTemporaryDir workDir;
+    QDir work(workDir.path());
+    work.mkpath("media");
+
+    ContentServer server;
+    QString url = parser.value(urlOption);
+    if (url.isEmpty()) {
+        if (! SyntheticMedia::generate(work.filePath("media"), 4, 2, 640, 360, 60)) {
+            return 1;
+        }
+
+        server.addDirectory(work.filePath("media"), 5000);
+        server.latency(parser.value(latencyOption).toInt());
+        server.bandwidth(parser.value(bandwidthOption).toLongLong() * 1024);
+        server.failureRate(parser.value(failureOption).toDouble());
+        server.churn(parser.value(churnOption).toInt());
+        server.publish();
+        server.listen();
+        url = server.url();
+    }
+
+    int instances = qMax(1, parser.value(instancesOption).toInt());
+    int refresh = qMax(100, parser.value(refreshOption).toInt());
+    int pushFallback = parser.value(pushOption).toInt();
+    std::vector<std::unique_ptr<Playlist>> playlists;
+    for (int i = 0; i < instances; i++) {
+        std::unique_ptr<Playlist> playlist(new Playlist);
+        playlist->cachePath(work.filePath(QString("player%1").arg(i)));
+        playlist->macAddress(QString("soak-%1").arg(i));
+        playlist->url(url);
+        playlist->refreshInterval(refresh);
+        if (pushFallback > 0) {
+            playlist->push(qMax(refresh, pushFallback));
+        }
+        playlists.push_back(std::move(playlist));
+    }
+
+    // the same families MediaCache and Playlist update
+    auto& downloadBytes = Metrics::counter("disupurei_download_bytes_total", "Bytes of media downloaded");
+    auto& downloadFailures = Metrics::counter("disupurei_download_failures_total", "Media downloads that failed");
+    auto& refreshFailures = Metrics::counter("disupurei_metadata_refresh_failures_total", "Sequence metadata requests that failed");
+    auto& refreshLatency = Metrics::histogram("disupurei_metadata_refresh_seconds", "Sequence metadata request latency",
+                                              {0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10});
+
+    QElapsedTimer clock;
+    clock.start();
+    double cpuStart = ProcessStats::cpuSeconds();
+    qint64 warmRss = -1;
+    quint64 lastBytes = 0;
+    qint64 lastReport = 0;
+    quint64 lastRefreshes = 0;
+    double lastCpu = cpuStart;
+
+    printf("%8s %9s %10s %9s %10s %8s %7s\n", "time s", "rss MB", "growth MB", "MB/s", "refresh/s", "fails", "cpu %");
+
+    QTimer report;
+    QObject::connect(&report, &QTimer::timeout, [&] {
+        qint64 now = clock.elapsed();
+        double seconds = (now - lastReport) / 1000.0;
+        qint64 rss = ProcessStats::residentBytes();
+        double cpu = ProcessStats::cpuSeconds();
+
+        // the first interval includes the initial downloads, growth is measured from there
+        if (warmRss < 0) {
+            warmRss = rss;
+        }
+
+        printf("%8.0f %9.1f %10.1f %9.2f %10.1f %8d %7.1f\n",
+               now / 1000.0,
+               rss / (1024.0 * 1024.0),
+               (rss - warmRss) / (1024.0 * 1024.0),
+               (downloadBytes.value() - lastBytes) / seconds / (1024 * 1024),
+               (refreshLatency.count() - lastRefreshes) / seconds,
+               (int) (downloadFailures.value() + refreshFailures.value()),
+               100.0 * (cpu - lastCpu) / seconds);
+        fflush(stdout);
+
+        lastReport = now;
+        lastBytes = downloadBytes.value();
+        lastRefreshes = refreshLatency.count();
+        lastCpu = cpu;
+    });
+    report.start(qMax(1, parser.value(reportOption).toInt()) * 1000);
+
+    QTimer::singleShot(qMax(1, parser.value(durationOption).toInt()) * 1000, &app, &QCoreApplication::quit);
+    app.exec();
+
+    qint64 growth = ProcessStats::residentBytes() - warmRss;
+    double cpuPercent = 100.0 * (ProcessStats::cpuSeconds() - cpuStart) / (clock.elapsed() / 1000.0);
+    printf("instances %d, refreshes %llu, downloaded %.1f MB, growth %.1f MB, cpu %.1f%%\n",
+           instances, (unsigned long long) refreshLatency.count(), downloadBytes.value() / (1024.0 * 1024.0),
+           growth / (1024.0 * 1024.0), cpuPercent);
+    // an external server keeps its own counts
+    if (! parser.isSet(urlOption)) {
+        printf("server requests %d, event streams %d, sent %.1f MB, injected failures %d\n",
+               server.requests(), server.eventStreams(), server.bytesSent() / (1024.0 * 1024.0), server.failures());
+    }
+
+    qint64 maxGrowth = parser.value(growthOption).toLongLong() * 1024 * 1024;
+    if (maxGrowth > 0 && warmRss >= 0 && growth > maxGrowth) {
+        printf("FAIL: RSS grew more than %s MB\n", qPrintable(parser.value(growthOption)));
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <ctime>
+#include <cstdio>
+
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include <gst/gst.h>
+
+#include "mediasource.h"
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Reads (or decodes) one file through every MediaSource mode and prints
+// throughput and CPU time per mode.
+
+static void dropFromPageCache(const QString& filename) {
+#ifdef Q_OS_LINUX
+    int fd = open(QFile::encodeName(filename).constData(), O_RDONLY);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#else
+    Q_UNUSED(filename)
+#endif
+}
+
+static bool runOnce(const QString& filename, MediaSource::Mode mode, guint blocksize, bool decode) {
+    GstElement* pipeline = gst_parse_launch(decode ?
+        "decodebin name=first ! fakesink sync=false" :
+        "fakesink name=first sync=false", NULL);
+
+    MediaSource source(filename, mode, blocksize);
+    GstElement* first = gst_bin_get_by_name(GST_BIN(pipeline), "first");
+    gst_bin_add(GST_BIN(pipeline), source.element());
+    gst_element_link(source.element(), first);
+    gst_object_unref(first);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    GstBus* bus = gst_element_get_bus(pipeline);
+    GstMessage* msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, (GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    bool ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    if (! ok) {
+        GError* err = NULL;
+        gst_message_parse_error(msg, &err, NULL);
+        std::cerr << MediaSource::modeName(mode) << ": " << err->message << std::endl;
+        g_error_free(err);
+    }
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    gst_init(&argc, &argv);
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    QCommandLineOption decodeOption = QCommandLineOption({{"d", "decode"}, "Demux and decode instead of only reading"});
+    QCommandLineOption coldOption = QCommandLineOption({{"c", "cold"}, "Drop the file from the page cache before every run"});
+    QCommandLineOption iterationsOption = QCommandLineOption({{"i", "iterations"}, "Runs per mode", "count", "5"});
+    QCommandLineOption blocksizeOption = QCommandLineOption({{"b", "blocksize"}, "Block size in KiB", "kib", "1024"});
+    parser.setApplicationDescription("disupurei_sourcebench - compare media source modes");
+    parser.addHelpOption();
+    parser.addOption(decodeOption);
+    parser.addOption(coldOption);
+    parser.addOption(iterationsOption);
+    parser.addOption(blocksizeOption);
+    parser.addPositionalArgument("file", "Media file to read");
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    QString filename = parser.positionalArguments().first();
+    qint64 fileSize = QFileInfo(filename).size();
+    int iterations = qMax(1, parser.value(iterationsOption).toInt());
+    guint blocksize = parser.value(blocksizeOption).toUInt() * 1024;
+    bool decode = parser.isSet(decodeOption);
+
+    printf("%-10s %10s %10s %8s\n", "mode", "MB/s", "cpu ms", "cpu %");
+    for (auto mode : {MediaSource::Mode::DEFAULT, MediaSource::Mode::BLOCKSIZE, MediaSource::Mode::READAHEAD, MediaSource::Mode::MMAP}) {
+        qint64 wallNsecs = 0;
+        double cpuSecs = 0;
+
+        for (int i = 0; i < iterations; i++) {
+            if (parser.isSet(coldOption)) {
+                dropFromPageCache(filename);
+            }
+
+            QElapsedTimer wall;
+            std::clock_t cpu = std::clock();
+            wall.start();
+
+            if (! runOnce(filename, mode, blocksize, decode)) {
+                return 1;
+            }
+
+            wallNsecs += wall.nsecsElapsed();
+            cpuSecs += (double) (std::clock() - cpu) / CLOCKS_PER_SEC;
+        }
+
+        double wallSecs = wallNsecs / 1e9;
+        printf("%-10s %10.1f %10.1f %7.1f%%\n", MediaSource::modeName(mode),
+               (fileSize * iterations) / wallSecs / (1024 * 1024),
+               cpuSecs * 1000 / iterations,
+               100.0 * cpuSecs / wallSecs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include "syntheticmedia.h"
+
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QPainter>
+#include <QStringList>
+#include <QLinearGradient>
+
+#include <QDebug>
+
+#include <gst/gst.h>
+
+struct Encoder {
+    const char* elements[3];
+    const char* description;
+};
+
+// first match wins, h264 in mp4 is what the server normally delivers
+static const Encoder _encoders[] = {
+    {{"x264enc", "h264parse", "mp4mux"}, "x264enc speed-preset=ultrafast ! h264parse ! mp4mux"},
+    {{"avenc_mpeg4", "qtmux", nullptr}, "avenc_mpeg4 ! qtmux"},
+    {{"jpegenc", "avimux", nullptr}, "jpegenc ! avimux"},
+};
+
+static const Encoder _audioEncoders[] = {
+    {{"fdkaacenc", nullptr, nullptr}, "fdkaacenc"},
+    {{"voaacenc", nullptr, nullptr}, "voaacenc"},
+    {{"faac", nullptr, nullptr}, "faac"},
+    {{"avenc_aac", nullptr, nullptr}, "avenc_aac"},
+};
+
+static bool _available(const Encoder& encoder) {
+    for (auto name : encoder.elements) {
+        if (name == nullptr) {
+            break;
+        }
+
+        GstElementFactory* factory = gst_element_factory_find(name);
+        if (factory == nullptr) {
+            return false;
+        }
+        gst_object_unref(factory);
+    }
+
+    return true;
+}
+
+template <size_t N>
+static const Encoder* _firstAvailable(const Encoder (&encoders)[N]) {
+    for (auto& candidate : encoders) {
+        if (_available(candidate)) {
+            return &candidate;
+        }
+    }
+    return nullptr;
+}
+
+bool SyntheticMedia::video(const QString &path, int width, int height, int frames, int fps, int audioChannels) {
+    const Encoder* encoder = _firstAvailable(_encoders);
+    if (encoder == nullptr) {
+        qWarning() << Q_FUNC_INFO << "No usable video encoder found";
+        return false;
+    }
+
+    QString description = QString("videotestsrc num-buffers=%1 pattern=ball ! "
+                                  "video/x-raw,width=%2,height=%3,framerate=%4/1 ! "
+                                  "videoconvert ! %5 name=mux ! filesink location=\"%6\"")
+            .arg(frames).arg(width).arg(height).arg(fps)
+            .arg(encoder->description).arg(path);
+
+    if (audioChannels > 0) {
+        const Encoder* audioEncoder = _firstAvailable(_audioEncoders);
+        if (audioEncoder == nullptr) {
+            qWarning() << Q_FUNC_INFO << "No usable AAC encoder found";
+            return false;
+        }
+
+        // one audio buffer per video frame keeps both tracks the same length,
+        // audioconvert upmixes the stereo noise to the usual surround layout
+        int rate = 48000;
+        QString channels = QString("channels=%1").arg(audioChannels);
+        if (audioChannels > 2) {
+            channels += QString(",channel-mask=(bitmask)0x%1").arg((1 << audioChannels) - 1, 0, 16);
+        }
+        description += QString(" audiotestsrc num-buffers=%1 samplesperbuffer=%2 wave=pink-noise ! "
+                               "audio/x-raw,rate=%3 ! audioconvert ! audio/x-raw,%4 ! %5 ! mux.")
+                .arg(frames).arg(rate / fps).arg(rate).arg(channels)
+                .arg(audioEncoder->description);
+    }
+
+    GError* error = NULL;
+    GstElement* pipeline = gst_parse_launch(description.toUtf8().constData(), &error);
+    if (pipeline == nullptr) {
+        qWarning() << Q_FUNC_INFO << error->message;
+        g_error_free(error);
+        return false;
+    }
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus* bus = gst_element_get_bus(pipeline);
+    GstMessage* msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, (GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    bool ok = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    gst_message_unref(msg);
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    if (! ok) {
+        qWarning() << Q_FUNC_INFO << "Failed to encode" << path;
+    }
+    return ok;
+}
+
+bool SyntheticMedia::image(const QString &path, int width, int height, int index) {
+    QImage image(width, height, QImage::Format_RGB32);
+
+    QLinearGradient gradient(0, 0, width, height);
+    gradient.setColorAt(0, QColor::fromHsv((index * 47) % 360, 200, 230));
+    gradient.setColorAt(1, QColor::fromHsv((index * 47 + 180) % 360, 200, 80));
+
+    QPainter painter(&image);
+    painter.fillRect(image.rect(), gradient);
+    painter.setPen(Qt::white);
+    painter.setFont(QFont("sans", height / 8));
+    painter.drawText(image.rect(), Qt::AlignCenter, QString::number(index));
+    painter.end();
+
+    return image.save(path, "JPG", 90);
+}
+
+bool SyntheticMedia::generate(const QString &directory, int images, int videos, int width, int height, int videoFrames) {
+    QDir dir(directory);
+
+    for (int i = 0; i < images; i++) {
+        if (! image(dir.filePath(QString("image%1.jpg").arg(i)), width, height, i)) {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < videos; i++) {
+        if (! video(dir.filePath(QString("video%1.mp4").arg(i)), width, height, videoFrames, 30)) {
+            return false;
+        }
+    }
+
+    return true;
+}
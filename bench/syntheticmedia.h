@@ -0,0 +1,19 @@
+#ifndef SYNTHETICMEDIA_H
+#define SYNTHETICMEDIA_H
+
+#include <QString>
+
+// Generated test content: videotestsrc clips encoded with whatever encoder
+// the local GStreamer install provides, and gradient images. Clips can
+// carry an AAC track of audioChannels channels, 6 is 5.1.
+class SyntheticMedia
+{
+public:
+    static bool video(const QString& path, int width, int height, int frames, int fps, int audioChannels = 0);
+    static bool image(const QString& path, int width, int height, int index);
+
+    // image<n>.jpg and video<n>.mp4 files, named the way ContentServer::addDirectory expects
+    static bool generate(const QString& directory, int images, int videos, int width, int height, int videoFrames);
+};
+
+#endif // SYNTHETICMEDIA_H
@@ -0,0 +1,182 @@
+#include "decodeprobe.h"
+#include "gstpipeline.h"
+#include "logger.h"
+#include "trace.h"
+
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QTemporaryDir>
+
+#include <gst/gst.h>
+
+struct ProbeEncoder {
+    const char* codec;
+    const char* element;
+    const char* description;
+};
+
+// per codec the first encoder found is used
+static const ProbeEncoder _encoders[] = {
+    {"h264", "x264enc", "x264enc speed-preset=ultrafast ! h264parse"},
+    {"h264", "openh264enc", "openh264enc ! h264parse"},
+    {"h264", "v4l2h264enc", "v4l2h264enc ! h264parse"},
+    {"h265", "x265enc", "x265enc speed-preset=ultrafast ! h265parse"},
+    {"h265", "v4l2h265enc", "v4l2h265enc ! h265parse"},
+    {"vp9", "vp9enc", "vp9enc deadline=1 cpu-used=8"},
+};
+
+static const int _heights[] = {720, 1080, 2160};
+static const int _frames = 60;
+static const int _fps = 30;
+// decoding has to stay this far ahead of the frame rate, the upload and
+// the draw need their share of the device too
+static const double _headroom = 1.25;
+
+static bool _runToEos(const QString& description, GstClockTime timeout) {
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch(description.toUtf8().constData(), &error);
+    if (pipeline == nullptr) {
+        qCWarning(lcPipeline) << Q_FUNC_INFO << (error != nullptr ? error->message : "") << description;
+        g_clear_error(&error);
+        return false;
+    }
+    g_clear_error(&error);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    GstBus* bus = gst_element_get_bus(pipeline);
+    GstMessage* msg = gst_bus_timed_pop_filtered(bus, timeout, (GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    bool ok = msg != nullptr && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    if (msg != nullptr) {
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return ok;
+}
+
+DecodeProbe::DecodeProbe() {
+    moveToThread(&_thread);
+    setObjectName("DecodeProbe");
+    _thread.setObjectName("DecodeProbe");
+
+    connect(this, &DecodeProbe::runRequested, this, &DecodeProbe::_run);
+    // not low priority, a probe starved by playback would settle for too little
+    _thread.start();
+}
+
+DecodeProbe::~DecodeProbe() {
+    _stopping = true;
+    _thread.quit();
+    _thread.wait();
+}
+
+QVector<DecodeLimit> DecodeProbe::cachedLimits(bool *probed) {
+    QVector<DecodeLimit> limits;
+    QSettings settings;
+    settings.beginGroup("decode/results");
+    bool current = settings.value("gstreamer").toString() == QString::fromUtf8(gst_version_string());
+    if (probed != nullptr) {
+        *probed = current;
+    }
+    if (! current) {
+        return limits;
+    }
+
+    for (auto& codec : settings.childGroups()) {
+        settings.beginGroup(codec);
+        DecodeLimit limit{codec, 0, 0};
+        for (auto& key : settings.childKeys()) {
+            int height = key.toInt();
+            double fps = settings.value(key).toDouble();
+            if (height > limit.height && fps >= _fps * _headroom) {
+                limit.height = height;
+                limit.fps = fps >= 60 * _headroom ? 60 : _fps;
+            }
+        }
+        settings.endGroup();
+
+        if (limit.height > 0) {
+            limits.append(limit);
+        }
+    }
+    return limits;
+}
+
+void DecodeProbe::run() {
+    emit runRequested();
+}
+
+void DecodeProbe::_run() {
+    TRACE_SPAN("DecodeProbe::run");
+    GstreamerPipeline::waitForGstreamer();
+
+    QSettings settings;
+    settings.remove("decode/results");
+    settings.beginGroup("decode/results");
+
+    QStringList probed;
+    for (auto& encoder : _encoders) {
+        if (probed.contains(encoder.codec)) {
+            continue;
+        }
+
+        GstElementFactory* factory = gst_element_factory_find(encoder.element);
+        if (factory == nullptr) {
+            continue;
+        }
+        gst_object_unref(factory);
+        probed.append(encoder.codec);
+
+        // taller clips are only tried while the last one kept up
+        for (int height : _heights) {
+            if (_stopping) {
+                return;
+            }
+
+            double fps = _decodeFps(encoder.description, height);
+            if (fps <= 0) {
+                break;
+            }
+
+            qCInfo(lcPipeline) << "Decoded" << encoder.codec << QString("%1p").arg(height) << "at" << fps << "fps";
+            settings.setValue(QString("%1/%2").arg(encoder.codec).arg(height), fps);
+            if (fps < _fps * _headroom) {
+                break;
+            }
+        }
+    }
+
+    settings.setValue("gstreamer", QString::fromUtf8(gst_version_string()));
+    settings.sync();
+    emit finished();
+}
+
+// frames decoded per second from a clip made with the given encoder,
+// or -1 when it could not be encoded or decoded at all
+double DecodeProbe::_decodeFps(const char *encoder, int height) {
+    QTemporaryDir dir;
+    QString path = dir.filePath("probe.mkv");
+
+    // a moving zone plate has detail everywhere, unlike a ball on black
+    QString encode = QString("videotestsrc num-buffers=%1 pattern=zone-plate kx2=20 ky2=20 kt=1 ! "
+                             "video/x-raw,format=I420,width=%2,height=%3,framerate=%4/1 ! "
+                             "%5 ! matroskamux ! filesink location=\"%6\"")
+            .arg(_frames).arg(height * 16 / 9).arg(height).arg(_fps)
+            .arg(encoder).arg(path);
+    if (! _runToEos(encode, 120 * GST_SECOND)) {
+        qCWarning(lcPipeline) << Q_FUNC_INFO << "Failed to encode a" << height << "line probe with" << encoder;
+        return -1;
+    }
+
+    // slower than a quarter of real time is as good as not decoding at all
+    QString decode = QString("filesrc location=\"%1\" ! decodebin ! fakesink sync=false").arg(path);
+    QElapsedTimer clock;
+    clock.start();
+    if (! _runToEos(decode, 4 * (_frames / _fps) * GST_SECOND)) {
+        return -1;
+    }
+
+    return _frames * 1000.0 / qMax<qint64>(1, clock.elapsed());
+}
@@ -0,0 +1,42 @@
+#ifndef DECODEPROBE_H
+#define DECODEPROBE_H
+
+#include "playlist.h"
+
+#include <QObject>
+#include <QThread>
+
+#include <atomic>
+
+// Finds out what the device decodes in real time. For every codec there is
+// a local encoder and parser for, short generated clips of rising height
+// are decoded as fast as possible. The measured frame rates are kept in the
+// settings under decode/, tagged with the GStreamer version, so the probe
+// only runs again after an upgrade. Codecs nothing could encode are not
+// probed, and give no limit.
+class DecodeProbe : public QObject
+{
+    Q_OBJECT
+public:
+    DecodeProbe();
+    ~DecodeProbe();
+
+    // probed is false until a probe has run against this GStreamer version
+    static QVector<DecodeLimit> cachedLimits(bool* probed);
+
+    void run();
+signals:
+    void finished();
+
+    void runRequested();
+
+private:
+    QThread _thread;
+    std::atomic<bool> _stopping{false};
+
+    double _decodeFps(const char* encoder, int height);
+private slots:
+    void _run();
+};
+
+#endif // DECODEPROBE_H
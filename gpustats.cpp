@@ -0,0 +1,164 @@
+#include "gpustats.h"
+#include "metrics.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+// GL_NVX_gpu_memory_info and GL_ATI_meminfo, both report KiB
+#define GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX 0x9048
+#define GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+#define TEXTURE_FREE_MEMORY_ATI 0x87FC
+
+static QMutex sampleMutex;
+static QElapsedTimer sampleClock;
+
+void GpuStats::sampleMemory() {
+    static auto& gpuAvailable = Metrics::gauge("disupurei_gpu_memory_available_bytes", "Free video memory as reported by the GL driver");
+    static auto& gpuTotal = Metrics::gauge("disupurei_gpu_memory_total_bytes", "Total video memory as reported by the GL driver");
+
+    {
+        QMutexLocker lock(&sampleMutex);
+        if (sampleClock.isValid() && sampleClock.elapsed() < 5000) {
+            return;
+        }
+        sampleClock.start();
+    }
+
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if (context == nullptr) {
+        return;
+    }
+
+    GLint values[4] = {0, 0, 0, 0};
+    if (context->hasExtension("GL_NVX_gpu_memory_info")) {
+        context->functions()->glGetIntegerv(GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, values);
+        gpuAvailable.set(values[0] * 1024.0);
+        context->functions()->glGetIntegerv(GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, values);
+        gpuTotal.set(values[0] * 1024.0);
+    } else if (context->hasExtension("GL_ATI_meminfo")) {
+        context->functions()->glGetIntegerv(TEXTURE_FREE_MEMORY_ATI, values);
+        gpuAvailable.set(values[0] * 1024.0);
+    }
+}
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+void GpuFrameTimer::initialize(QOpenGLContext *context) {
+    QByteArray suffix;
+    if (context->isOpenGLES()) {
+        if (! context->hasExtension("GL_EXT_disjoint_timer_query")) {
+            return;
+        }
+        suffix = "EXT";
+        _checkDisjoint = true;
+    } else if (context->format().version() < qMakePair(3, 3) && ! context->hasExtension("GL_ARB_timer_query")) {
+        return;
+    }
+
+    _genQueries = reinterpret_cast<GenQueries>(context->getProcAddress("glGenQueries" + suffix));
+    _deleteQueries = reinterpret_cast<DeleteQueries>(context->getProcAddress("glDeleteQueries" + suffix));
+    _beginQuery = reinterpret_cast<BeginQuery>(context->getProcAddress("glBeginQuery" + suffix));
+    _endQuery = reinterpret_cast<EndQuery>(context->getProcAddress("glEndQuery" + suffix));
+    _getQueryObjectuiv = reinterpret_cast<GetQueryObjectuiv>(context->getProcAddress("glGetQueryObjectuiv" + suffix));
+    _getQueryObjectui64v = reinterpret_cast<GetQueryObjectui64v>(context->getProcAddress("glGetQueryObjectui64v" + suffix));
+    if (_genQueries == nullptr || _deleteQueries == nullptr || _beginQuery == nullptr ||
+            _endQuery == nullptr || _getQueryObjectuiv == nullptr || _getQueryObjectui64v == nullptr) {
+        _genQueries = nullptr;
+        return;
+    }
+
+    _functions = context->functions();
+    _genQueries(_depth, _queries);
+}
+
+void GpuFrameTimer::cleanup() {
+    if (_genQueries == nullptr) {
+        return;
+    }
+
+    if (_running) {
+        _endQuery(GL_TIME_ELAPSED);
+        _running = false;
+    }
+    _deleteQueries(_depth, _queries);
+    for (int i = 0; i < _depth; i++) {
+        _queries[i] = 0;
+        _pending[i] = false;
+    }
+    _genQueries = nullptr;
+}
+
+void GpuFrameTimer::begin() {
+    if (_genQueries == nullptr) {
+        return;
+    }
+
+    _collect();
+
+    // all queries still in flight, this frame goes unmeasured
+    if (_pending[_next]) {
+        return;
+    }
+
+    _beginQuery(GL_TIME_ELAPSED, _queries[_next]);
+    _running = true;
+}
+
+void GpuFrameTimer::end() {
+    if (! _running) {
+        return;
+    }
+
+    _endQuery(GL_TIME_ELAPSED);
+    _running = false;
+    _pending[_next] = true;
+    _next = (_next + 1) % _depth;
+}
+
+void GpuFrameTimer::_collect() {
+    static auto& frameSeconds = Metrics::histogram("disupurei_gpu_frame_seconds", "GPU time spent drawing a frame, from timer queries",
+                                                   {0.0005, 0.001, 0.002, 0.004, 0.008, 0.016, 0.033});
+
+    // a disjoint operation (e.g. a frequency change) invalidates everything in flight
+    GLint disjoint = 0;
+    if (_checkDisjoint) {
+        _functions->glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    }
+
+    // oldest first, results become available in submission order
+    for (int i = 0; i < _depth; i++) {
+        int index = (_next + i) % _depth;
+        if (! _pending[index]) {
+            continue;
+        }
+
+        GLuint available = 0;
+        _getQueryObjectuiv(_queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (! available) {
+            break;
+        }
+
+        quint64 nanoseconds = 0;
+        _getQueryObjectui64v(_queries[index], GL_QUERY_RESULT, &nanoseconds);
+        _pending[index] = false;
+        if (! disjoint) {
+            frameSeconds.observe(nanoseconds / 1e9);
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef GPUSTATS_H
+#define GPUSTATS_H
+
+#include <QOpenGLFunctions>
+
+class QOpenGLContext;
+
+// Video memory gauges read from the GL driver. Called from whichever
+// thread draws, with its context current; samples at most every 5s.
+class GpuStats
+{
+public:
+    static void sampleMemory();
+};
+
+// GPU time spent between begin() and end(), observed as
+// disupurei_gpu_frame_seconds. Uses GL_ARB_timer_query (core in GL 3.3) or
+// GL_EXT_disjoint_timer_query on GLES, and reads results back a few frames
+// later so the CPU never waits on the GPU. Does nothing without either.
+class GpuFrameTimer
+{
+public:
+    void initialize(QOpenGLContext* context);
+    void cleanup();
+
+    void begin();
+    void end();
+
+private:
+    typedef void (QOPENGLF_APIENTRYP GenQueries)(GLsizei n, GLuint* ids);
+    typedef void (QOPENGLF_APIENTRYP DeleteQueries)(GLsizei n, const GLuint* ids);
+    typedef void (QOPENGLF_APIENTRYP BeginQuery)(GLenum target, GLuint id);
+    typedef void (QOPENGLF_APIENTRYP EndQuery)(GLenum target);
+    typedef void (QOPENGLF_APIENTRYP GetQueryObjectuiv)(GLuint id, GLenum pname, GLuint* params);
+    typedef void (QOPENGLF_APIENTRYP GetQueryObjectui64v)(GLuint id, GLenum pname, quint64* params);
+
+    static const int _depth = 4;
+
+    QOpenGLFunctions* _functions = nullptr;
+    GenQueries _genQueries = nullptr;
+    DeleteQueries _deleteQueries = nullptr;
+    BeginQuery _beginQuery = nullptr;
+    EndQuery _endQuery = nullptr;
+    GetQueryObjectuiv _getQueryObjectuiv = nullptr;
+    GetQueryObjectui64v _getQueryObjectui64v = nullptr;
+    bool _checkDisjoint = false;
+
+    GLuint _queries[_depth] = {0, 0, 0, 0};
+    bool _pending[_depth] = {false, false, false, false};
+    int _next = 0;
+    bool _running = false;
+
+    void _collect();
+};
+
+#endif // GPUSTATS_H
@@ -1,12 +1,33 @@
 #include <QDebug>
 
 #include "gstpipeline.h"
+#include "logger.h"
+#include "metrics.h"
+#include "startupprofile.h"
+#include "syncclock.h"
+#include "trace.h"
 
 #define GST_USE_UNSTABLE_API
 #include <gst/gl/gstglconfig.h>
+#include <gst/gl/gstglbasememory.h>
+#include <gst/gl/gstglcontext.h>
+#include <gst/gl/gstglmemory.h>
+#include <gst/gl/gstglsyncmeta.h>
+#include <gst/base/gstbasesink.h>
 
 #include <QOpenGLContext>
 
+#include <QDir>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStandardPaths>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <future>
+
 #if GST_GL_HAVE_PLATFORM_EGL
 	#include <QtPlatformHeaders/QEGLNativeContext>
 	#include <gst/gl/egl/gstgldisplay_egl.h>
@@ -31,15 +52,259 @@ void _g_main_loop_thread(void) {
 }
 #endif
 
+static std::thread _gstLoaderThread;
+static std::promise<void> _gstInitialized;
+static std::shared_future<void> _gstReady;
+
+static int _stateTimeout = 10000;
+static int _stallTimeout = 5000;
+
+static std::atomic<int> _livePipelines(0);
+static std::atomic<int> _strayReferences(0);
+
+// elements the video and poster pipelines are built from, instantiated once
+// up front
+static const char* _preloadElements[] = {
+    "filesrc", "decodebin", "typefind", "glupload", "glcolorconvert", "capsfilter", "fakesink", "videoconvert"
+};
+
+// post-processors decodebin plugs behind a hardware decoder that scale to
+// whatever size the caps downstream ask for, on the decoder's own hardware.
+// vaapidecodebin brings vaapipostproc; the v4l2 decoders keep the capture
+// queue at the coded size and have no such element.
+static const char* _decoderScalers[] = {
+    "vaapipostproc"
+};
+
+static const char* _anyCaps = "ANY";
+static const char* _scaledCaps = "video/x-raw(ANY), width=(int)%1, height=(int)%2";
+
+// whether the chain decodebin built for this pad ends in a scaler and that
+// scaler offers the size; a software decoder offers any size in its caps
+// query but then fails to negotiate it
+static bool _decoderCanScale(GstElement* decodebin, GstPad* pad, int width, int height) {
+    bool found = false;
+    GstIterator* it = gst_bin_iterate_recurse(GST_BIN(decodebin));
+    GValue item = G_VALUE_INIT;
+    bool done = false;
+    while (! done && ! found) {
+        switch (gst_iterator_next(it, &item)) {
+        case GST_ITERATOR_OK: {
+            GstElementFactory* factory = gst_element_get_factory(GST_ELEMENT(g_value_get_object(&item)));
+            for (auto name : _decoderScalers) {
+                if (factory != nullptr && g_str_equal(gst_plugin_feature_get_name(factory), name)) {
+                    found = true;
+                }
+            }
+            g_value_reset(&item);
+            break;
+        }
+        case GST_ITERATOR_RESYNC:
+            gst_iterator_resync(it);
+            break;
+        default:
+            done = true;
+            break;
+        }
+    }
+    g_value_unset(&item);
+    gst_iterator_free(it);
+    if (! found) {
+        return false;
+    }
+
+    GstCaps* filter = gst_caps_from_string(qPrintable(QString(_scaledCaps).arg(width).arg(height)));
+    GstCaps* allowed = gst_pad_query_caps(pad, filter);
+    bool offered = ! gst_caps_is_empty(allowed);
+    gst_caps_unref(allowed);
+    gst_caps_unref(filter);
+    return offered;
+}
+
+// GStreamer's version, the plugin path from the environment and the
+// modification time of every directory plugins were found in. A plugin
+// added, removed or replaced anywhere on the path changes it.
+static QString _pluginPathStamp(const QStringList& directories) {
+    if (directories.isEmpty()) {
+        return QString();
+    }
+
+    QStringList stamp;
+    stamp << QString::fromUtf8(gst_version_string())
+          << QString::fromLocal8Bit(qgetenv("GST_PLUGIN_PATH"))
+          << QString::fromLocal8Bit(qgetenv("GST_PLUGIN_SYSTEM_PATH"));
+    for (auto& directory : directories) {
+        QFileInfo info(directory);
+        stamp << QString("%1 %2").arg(directory).arg(info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1);
+    }
+    return stamp.join('\n');
+}
+
+// Keep the registry in our own cache and skip the plugin rescan while
+// neither GStreamer nor any plugin directory changed since the last start.
+static void _useCachedRegistry() {
+    QDir cachePath(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+    if (! cachePath.exists()) {
+        cachePath.mkpath(".");
+    }
+
+    QString registry = cachePath.filePath("gstreamer-registry.bin");
+    if (qEnvironmentVariableIsEmpty("GST_REGISTRY")) {
+        qputenv("GST_REGISTRY", QFile::encodeName(registry));
+    }
+
+    QSettings settings;
+    QString stamp = _pluginPathStamp(settings.value("gstreamer/pluginDirectories").toStringList());
+    if (qEnvironmentVariableIsEmpty("GST_REGISTRY_UPDATE") && QFile::exists(registry) &&
+        ! stamp.isEmpty() && stamp == settings.value("gstreamer/registryStamp").toString()) {
+        qputenv("GST_REGISTRY_UPDATE", "no");
+    }
+}
+
+static void _storeRegistryStamp() {
+    QStringList directories;
+    GList* plugins = gst_registry_get_plugin_list(gst_registry_get());
+    for (GList* item = plugins; item != nullptr; item = item->next) {
+        const gchar* filename = gst_plugin_get_filename(GST_PLUGIN(item->data));
+        if (filename == nullptr) {
+            continue;
+        }
+        QString directory = QFileInfo(QFile::decodeName(filename)).absolutePath();
+        if (! directories.contains(directory)) {
+            directories.append(directory);
+        }
+    }
+    gst_plugin_list_free(plugins);
+    directories.sort();
+
+    QSettings settings;
+    settings.remove("gstreamer/pluginDirectory");
+    settings.setValue("gstreamer/pluginDirectories", directories);
+    settings.setValue("gstreamer/registryStamp", _pluginPathStamp(directories));
+}
+
+static void _loadFeatures(GList* features) {
+    for (GList* item = features; item != nullptr; item = item->next) {
+        GstPluginFeature* feature = gst_plugin_feature_load(GST_PLUGIN_FEATURE(item->data));
+        if (feature == nullptr) {
+            continue;
+        }
+
+        // run class_init now instead of on the first decodebin autoplug
+        if (GST_IS_ELEMENT_FACTORY(feature)) {
+            GType type = gst_element_factory_get_element_type(GST_ELEMENT_FACTORY(feature));
+            if (type != G_TYPE_INVALID) {
+                g_type_class_unref(g_type_class_ref(type));
+            }
+        }
+        gst_object_unref(feature);
+    }
+}
+
+static void _preloadPlugins() {
+    for (auto name : _preloadElements) {
+        GstElement* element = gst_element_factory_make(name, NULL);
+        if (element == nullptr) {
+            qCWarning(lcPipeline) << Q_FUNC_INFO << "Missing element" << name;
+            continue;
+        }
+        gst_object_unref(element);
+    }
+
+    GList* typefinders = gst_type_find_factory_get_list();
+    _loadFeatures(typefinders);
+    gst_plugin_feature_list_free(typefinders);
+
+    GstElementFactoryListType types[] = {
+        GST_ELEMENT_FACTORY_TYPE_DEMUXER,
+        GST_ELEMENT_FACTORY_TYPE_PARSER | GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO,
+        GST_ELEMENT_FACTORY_TYPE_DECODER | GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO
+    };
+    for (auto type : types) {
+        GList* factories = gst_element_factory_list_get_elements(type, GST_RANK_MARGINAL);
+        _loadFeatures(factories);
+        gst_plugin_feature_list_free(factories);
+    }
+
+    _storeRegistryStamp();
+    StartupProfile::mark("gst preload");
+}
+
+void GstreamerPipeline::initGstreamer(bool async) {
+    // the promise can be satisfied only once
+    if (_gstReady.valid()) {
+        return;
+    }
+
+    _useCachedRegistry();
+    _gstReady = _gstInitialized.get_future().share();
+
+    auto init = [] {
+        gst_init (NULL, NULL);
+        Trace::installGstreamerHooks();
+        StartupProfile::mark("gst_init");
+        _gstInitialized.set_value();
+    };
+
+    if (async) {
+        _gstLoaderThread = std::thread([init] {
+            init();
+            _preloadPlugins();
+        });
+    } else {
+        init();
+        _gstLoaderThread = std::thread(_preloadPlugins);
+    }
+}
+
+void GstreamerPipeline::waitForGstreamer() {
+    if (_gstReady.valid()) {
+        _gstReady.wait();
+    }
+}
+
+void GstreamerPipeline::shutdownGstreamer() {
+    if (_gstLoaderThread.joinable()) {
+        _gstLoaderThread.join();
+    }
+}
+
+void GstreamerPipeline::timeouts(int stateMillis, int stallMillis) {
+    _stateTimeout = qMax(100, stateMillis);
+    _stallTimeout = qMax(100, stallMillis);
+}
+
+int GstreamerPipeline::livePipelines() {
+    return _livePipelines;
+}
+
+int GstreamerPipeline::strayReferences() {
+    return _strayReferences;
+}
+
 GstreamerPipeline::GstreamerPipeline() {
 #ifdef Q_OS_WIN
     _loop = g_main_loop_new(g_main_context_default(), false);
     _loop_thread = g_thread_new("glib_main_loop", (GThreadFunc) _g_main_loop_thread, this);
 #endif
+    // parented, so they move to the pipeline thread along with us
+    _stateTimer.setParent(this);
+    _stateTimer.setSingleShot(true);
+    _watchdog.setParent(this);
+    _watchdog.setInterval(500);
+
     moveToThread(&_thread);
     setObjectName("GstreamerPipeline");
+    _thread.setObjectName("GstreamerPipeline");
 
     connect(this, &GstreamerPipeline::openFileRequested, this, &GstreamerPipeline::_open);
+    connect(this, &GstreamerPipeline::stopRequested, this, &GstreamerPipeline::_stop);
+    connect(this, &GstreamerPipeline::resizeRequested, this, &GstreamerPipeline::_resize);
+    connect(this, &GstreamerPipeline::asyncDoneReceived, this, &GstreamerPipeline::_onAsyncDone);
+    connect(this, &GstreamerPipeline::eosReceived, this, &GstreamerPipeline::_onEos);
+    connect(this, &GstreamerPipeline::errorReceived, this, &GstreamerPipeline::_onError);
+    connect(&_stateTimer, &QTimer::timeout, this, &GstreamerPipeline::_onStateTimeout);
+    connect(&_watchdog, &QTimer::timeout, this, &GstreamerPipeline::_onWatchdog);
     _thread.start();
 }
 
@@ -49,11 +314,20 @@ GstreamerPipeline::~GstreamerPipeline() {
     g_thread_join(_loop_thread);
 #endif
 
-    frameDrawn();
-    stop();
+    // on the way out the pipeline is torn down for real, but a wedged one
+    // still doesn't get to hold up the exit
+    _disposeWait = 2000;
+    QMetaObject::invokeMethod(this, "_stop", Qt::BlockingQueuedConnection);
 
     _thread.quit();
     _thread.wait();
+
+    if (_context != nullptr) {
+        gst_object_unref(_context);
+    }
+    if (_display != nullptr) {
+        gst_object_unref(_display);
+    }
 }
 
 void GstreamerPipeline::initialize(QOpenGLContext *context) {
@@ -83,12 +357,12 @@ void GstreamerPipeline::initialize(QOpenGLContext *context) {
     }
 #endif
     if (gstDisplay == nullptr) {
-        qWarning() << Q_FUNC_INFO << "Couldn't find display";
+        qCWarning(lcPipeline) << Q_FUNC_INFO << "Couldn't find display";
         return;
     }
 
     if (gstContext == nullptr) {
-        qWarning() << Q_FUNC_INFO << "Couldn't find context";
+        qCWarning(lcPipeline) << Q_FUNC_INFO << "Couldn't find context";
         return;
     }
 
@@ -96,42 +370,164 @@ void GstreamerPipeline::initialize(QOpenGLContext *context) {
     _context = gstContext;
 }
 
-void GstreamerPipeline::notifyNewFrame(guint texture) {
+int GstreamerPipeline::open(const QString &filename, quint64 startTime) {
+    int frameGeneration = ++_opened;
+    emit openFileRequested(filename, startTime, frameGeneration);
+    return frameGeneration;
+}
+
+void GstreamerPipeline::targetSize(int width, int height) {
+    _targetWidth = width;
+    _targetHeight = height;
+    emit resizeRequested();
+}
+
+// the largest even size with the source's aspect that fits the target,
+// false when the source already fits
+bool GstreamerPipeline::_scaledSize(int *width, int *height) const {
+    int sourceWidth = _sourceWidth;
+    int sourceHeight = _sourceHeight;
+    int targetWidth = _targetWidth;
+    int targetHeight = _targetHeight;
+    if (sourceWidth <= 0 || sourceHeight <= 0 || targetWidth <= 0 || targetHeight <= 0 ||
+        (sourceWidth <= targetWidth && sourceHeight <= targetHeight)) {
+        *width = sourceWidth;
+        *height = sourceHeight;
+        return false;
+    }
+
+    double factor = qMin((double) targetWidth / sourceWidth, (double) targetHeight / sourceHeight);
+    *width = qMax(2, qRound(sourceWidth * factor) & ~1);
+    *height = qMax(2, qRound(sourceHeight * factor) & ~1);
+    return true;
+}
+
+// the size filter's new caps send a reconfigure upstream and the decoder's
+// scaler renegotiates to them with the next frame
+void GstreamerPipeline::_resize() {
+    // a video the decoder can't scale is left to the renderer
+    if (_pipeline == nullptr || ! _scaling) {
+        return;
+    }
+
+    int width, height;
+    bool scaled = _scaledSize(&width, &height);
+    GstCaps* caps = gst_caps_from_string(scaled ? qPrintable(QString(_scaledCaps).arg(width).arg(height)) : _anyCaps);
+    GstElement* sizefilter = gst_bin_get_by_name(GST_BIN(_pipeline), "sizefilter");
+    g_object_set(G_OBJECT(sizefilter), "caps", caps, NULL);
+    gst_object_unref(sizefilter);
+    gst_caps_unref(caps);
+
+    qCDebug(lcPipeline) << "Decoding video at" << width << "x" << height;
+    if (_state == PipelineState::PAUSED || _state == PipelineState::PLAYING) {
+        emit videoSize(width, height);
+    }
+}
+
+void GstreamerPipeline::notifyNewFrame(const VideoFrame& frame) {
     QMutexLocker lock(&_mutex);
+    if (_flushing) {
+        return;
+    }
 
-    emit newFrameReady(texture);
-    _wait.wait(&_mutex);
+    emit newFrameReady(frame);
 }
 
-void GstreamerPipeline::frameDrawn() {
+void GstreamerPipeline::_flush(bool flushing) {
     QMutexLocker lock(&_mutex);
-    _wait.wakeAll();
+    _flushing = flushing;
+}
+
+// Going to NULL joins the streaming threads. An element stuck in a read or
+// in the decoder would take the pipeline thread, and every later open, down
+// with it, so teardown runs on a thread of its own.
+static void _disposePipeline(GstPipeline* pipeline, MediaSource* source, GstGLDisplay* display, GstGLContext* context, int waitMillis) {
+    auto done = std::make_shared<std::promise<void>>();
+    std::future<void> disposed = done->get_future();
+
+    // the GL elements release their GL resources on the way to NULL, which
+    // may be after the GstreamerPipeline has dropped its own references
+    if (display != nullptr) {
+        gst_object_ref(display);
+    }
+    if (context != nullptr) {
+        gst_object_ref(context);
+    }
+
+    std::thread([pipeline, source, display, context, done] {
+        gst_element_set_state (GST_ELEMENT (pipeline), GST_STATE_NULL);
+        if (GST_OBJECT_REFCOUNT_VALUE(pipeline) > 1) {
+            qCWarning(lcPipeline) << "Pipeline still referenced" << GST_OBJECT_REFCOUNT_VALUE(pipeline) - 1 << "times when released";
+            _strayReferences++;
+        }
+        gst_object_unref(pipeline);
+        delete source;
+        if (context != nullptr) {
+            gst_object_unref(context);
+        }
+        if (display != nullptr) {
+            gst_object_unref(display);
+        }
+        done->set_value();
+    }).detach();
+
+    if (waitMillis > 0 && disposed.wait_for(std::chrono::milliseconds(waitMillis)) != std::future_status::ready) {
+        qCWarning(lcPipeline) << "Pipeline didn't reach NULL within" << waitMillis << "ms, abandoning it";
+    }
 }
 
-void GstreamerPipeline::stop() {
-    if (_state == PipelineState::PLAYING || _state == PipelineState::PAUSED) {
+void GstreamerPipeline::_stop() {
+    if (_state != PipelineState::STOPPED) {
         _stopPipeline();
     }
 }
 
-void GstreamerPipeline::_open(const QString &filename) {
+void GstreamerPipeline::_open(const QString &filename, quint64 startTime, int frameGeneration) {
+    TRACE_SPAN("GstreamerPipeline::_open");
+
+    // a pipeline that never finished the previous entry is still around, don't leak it
+    if (_pipeline != nullptr) {
+        _stopPipeline();
+    }
+
+    // the preload keeps running, a plugin it hasn't reached yet is loaded
+    // by decodebin when it autoplugs
+    waitForGstreamer();
+
+    // decodebin is linked to the rest once its first video pad shows up.
+    // The size filter asks a decoder that can scale for the screen's size,
+    // NV12 and I420 pass through as decoded, anything else is converted on
+    // the GPU; the draw shader scales what the decoder didn't.
     _pipeline = GST_PIPELINE (gst_parse_launch
-      ("filesrc name=filesrc ! "
-       "decodebin ! "
+      ("decodebin name=decodebin "
+       "capsfilter name=sizefilter ! "
        "glupload name=glupload ! "
        "glcolorconvert ! "
-       "video/x-raw(memory:GLMemory), format=(string)RGBA ! "
+       "video/x-raw(memory:GLMemory), format=(string){ NV12, I420, RGBA }, texture-target=(string)2D ! "
        "fakesink name=fakesink sync=1"
        , NULL));
+    _livePipelines++;
+    g_object_weak_ref(G_OBJECT(_pipeline), (GWeakNotify) pipeline_finalized, NULL);
+    _scaling = false;
 
-    _filesrc = gst_bin_get_by_name(GST_BIN(_pipeline), "filesrc");
-    g_assert(_filesrc != nullptr);
+    _source = std::unique_ptr<MediaSource>(new MediaSource(filename));
+    GstElement *decodebin = gst_bin_get_by_name(GST_BIN(_pipeline), "decodebin");
+    gst_bin_add(GST_BIN(_pipeline), _source->element());
+    if (! gst_element_link(_source->element(), decodebin)) {
+        qCWarning(lcPipeline) << Q_FUNC_INFO << "Failed to link" << MediaSource::modeName(_source->mode()) << "source for" << filename;
+    }
+    g_signal_connect (decodebin, "pad-added", G_CALLBACK (on_pad_added), this);
+    videoOnly(decodebin);
+    gst_object_unref(decodebin);
 
     _glupload = gst_bin_get_by_name(GST_BIN(_pipeline), "glupload");
     g_assert(_glupload != nullptr);
 
+    // messages from a pipeline we have moved on from are dropped by generation
+    _generation++;
+    BusWatch* watch = new BusWatch{this, _generation};
     m_bus = gst_pipeline_get_bus (GST_PIPELINE (_pipeline));
-    gst_bus_add_watch (m_bus, (GstBusFunc) bus_call, this);
+    gst_bus_add_watch_full (m_bus, G_PRIORITY_DEFAULT, (GstBusFunc) bus_call, watch, bus_watch_free);
     gst_bus_enable_sync_message_emission (m_bus);
     g_signal_connect (m_bus, "sync-message", G_CALLBACK (sync_bus_call), this);
     gst_object_unref (m_bus);
@@ -139,126 +535,458 @@ void GstreamerPipeline::_open(const QString &filename) {
     GstElement *fakesink = gst_bin_get_by_name (GST_BIN (_pipeline), "fakesink");
     g_object_set (G_OBJECT (fakesink), "signal-handoffs", TRUE, NULL);
     g_signal_connect (fakesink, "handoff", G_CALLBACK (on_gst_buffer), this);
-    gst_object_unref (fakesink);
+    GstPad *sinkpad = gst_element_get_static_pad (fakesink, "sink");
+    gst_pad_add_probe (sinkpad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM, on_allocation_query, NULL, NULL);
+    gst_object_unref (sinkpad);
 
-    QByteArray bytes = filename.toUtf8();
-    g_object_set(_filesrc, "location", bytes.constData(), NULL);
+    _startTime = startTime;
+    if (SyncClock::enabled() && GST_CLOCK_TIME_IS_VALID(_startTime)) {
+        // every instance runs this file against the same clock and base time,
+        // one that prerolled late drops frames to catch up instead of lagging
+        gst_pipeline_use_clock(_pipeline, SyncClock::clock());
+        gst_element_set_start_time(GST_ELEMENT(_pipeline), GST_CLOCK_TIME_NONE);
+        g_object_set (G_OBJECT (fakesink), "max-lateness", (gint64) (20 * GST_MSECOND), "qos", TRUE, NULL);
+    } else {
+        _startTime = GST_CLOCK_TIME_NONE;
+    }
+    gst_object_unref (fakesink);
 
+    _filename = filename;
+    _frameGeneration = frameGeneration;
+    _awaitingFirstBuffer = true;
+    _flush(false);
     _pausePipeline();
-    _startPipeline();
 }
 
 void GstreamerPipeline::_pausePipeline() {
-    gst_element_set_state (GST_ELEMENT (_pipeline), GST_STATE_PAUSED);
-    GstState state = GST_STATE_PAUSED;
-    GstStateChangeReturn stateChange = gst_element_get_state(GST_ELEMENT (_pipeline), &state, NULL, GST_CLOCK_TIME_NONE);
-    if (stateChange == GST_STATE_CHANGE_FAILURE && state != GST_STATE_READY) {
-        qDebug() << "failed to pause pipeline" << state;
+    TRACE_SPAN("GstreamerPipeline::_pausePipeline");
+
+    // prerolling completes with ASYNC_DONE on the bus, or never on a
+    // broken file, which the state timer catches
+    _state = PipelineState::PREROLLING;
+    _stateTimer.start(_stateTimeout);
+    GstStateChangeReturn stateChange = gst_element_set_state (GST_ELEMENT (_pipeline), GST_STATE_PAUSED);
+    if (stateChange == GST_STATE_CHANGE_FAILURE) {
+        qCWarning(lcPipeline) << "Failed to pause pipeline for" << _filename;
+        _abort();
+    } else if (stateChange == GST_STATE_CHANGE_SUCCESS || stateChange == GST_STATE_CHANGE_NO_PREROLL) {
+        _onAsyncDone(_generation);
+    }
+}
+
+void GstreamerPipeline::_onAsyncDone(int generation) {
+    if (generation != _generation || _state != PipelineState::PREROLLING) {
         return;
     }
 
     GstPad* pad = gst_element_get_static_pad(_glupload, "src");
     GstCaps* caps = gst_pad_get_current_caps(pad);
-    for (guint i = 0; i < gst_caps_get_size(caps); i++) {
-        GstStructure *structure = gst_caps_get_structure(caps, i);
+    gst_object_unref(pad);
+    if (caps != nullptr) {
+        for (guint i = 0; i < gst_caps_get_size(caps); i++) {
+            GstStructure *structure = gst_caps_get_structure(caps, i);
+
+            auto width = gst_structure_get_value(structure, "width");
+            auto height = gst_structure_get_value(structure, "height");
 
-        auto width = gst_structure_get_value(structure, "width");
-        auto height = gst_structure_get_value(structure, "height");
+            emit videoSize(g_value_get_int(width), g_value_get_int(height));
+        }
+        gst_caps_unref(caps);
+    }
 
-        emit videoSize(g_value_get_int(width), g_value_get_int(height));
+    gint64 duration = 0;
+    if (gst_element_query_duration(GST_ELEMENT(_pipeline), GST_FORMAT_TIME, &duration) && duration > 0) {
+        emit durationChanged(duration / GST_MSECOND);
     }
 
     _state = PipelineState::PAUSED;
+    _startPipeline();
 }
 
 void GstreamerPipeline::_startPipeline() {
+    TRACE_SPAN("GstreamerPipeline::_startPipeline");
+
+    _stateTimer.stop();
+    if (GST_CLOCK_TIME_IS_VALID(_startTime)) {
+        static auto& missed = Metrics::counter("disupurei_sync_late_starts_total", "Synchronized videos that prerolled after their start time");
+
+        if (SyncClock::now() > _startTime) {
+            missed.add();
+            qCWarning(lcSync) << "Prerolled" << (SyncClock::now() - _startTime) / GST_MSECOND << "ms after the start time of" << _filename;
+        }
+        gst_element_set_base_time(GST_ELEMENT(_pipeline), _startTime);
+    }
     GstStateChangeReturn ret = gst_element_set_state (GST_ELEMENT (_pipeline), GST_STATE_PLAYING);
     if (ret == GST_STATE_CHANGE_FAILURE) {
-        qDebug ("Failed to start up pipeline!");
+        qCWarning(lcPipeline, "Failed to start up pipeline!");
 
         /* check if there is an error message with details on the bus */
         GstMessage *msg = gst_bus_poll (this->m_bus, GST_MESSAGE_ERROR, 0);
         if (msg) {
             GError *err = NULL;
             gst_message_parse_error (msg, &err, NULL);
-            qDebug ("ERROR: %s", err->message);
+            qCWarning(lcPipeline, "ERROR: %s", err->message);
             g_error_free (err);
             gst_message_unref (msg);
         }
+        _abort();
         return;
     }
 
     _state = PipelineState::PLAYING;
+    _lastProgress.start();
+    _watchdog.start();
 }
 
 void GstreamerPipeline::_stopPipeline() {
-    gst_element_set_state (GST_ELEMENT (_pipeline), GST_STATE_NULL);
-    GstState state = GST_STATE_NULL;
-    if (gst_element_get_state (GST_ELEMENT (_pipeline), &state, NULL, GST_CLOCK_TIME_NONE) != GST_STATE_CHANGE_SUCCESS) {
-        qDebug ("failed to stop pipeline");
-        return;
-    }
+    TRACE_SPAN("GstreamerPipeline::_stopPipeline");
 
-    m_bus = gst_pipeline_get_bus (GST_PIPELINE (_pipeline));
-    gst_bus_remove_watch(m_bus);
-    gst_object_unref (m_bus);
+    _stateTimer.stop();
+    _watchdog.stop();
+    _flush(true);
 
     if (_glupload != nullptr) {
         gst_object_unref(_glupload);
-    }
-    if (_filesrc != nullptr) {
-        gst_object_unref(_filesrc);
+        _glupload = nullptr;
     }
     if (_pipeline != nullptr) {
-        gst_object_unref(_pipeline);
+        // the pipeline may outlive us on its way down, cut it off from this object
+        m_bus = gst_pipeline_get_bus (GST_PIPELINE (_pipeline));
+        gst_bus_remove_watch(m_bus);
+        g_signal_handlers_disconnect_by_data(m_bus, this);
+        gst_object_unref (m_bus);
+
+        // Disconnecting doesn't wait for a handoff already running on the
+        // streaming thread. Flushing gets that thread out of the sink, out
+        // of a preroll or clock wait too, and holding the stream lock while
+        // disconnecting waits until it has left on_gst_buffer.
+        GstElement *fakesink = gst_bin_get_by_name (GST_BIN (_pipeline), "fakesink");
+        GstPad *sinkpad = gst_element_get_static_pad (fakesink, "sink");
+        gst_pad_send_event (sinkpad, gst_event_new_flush_start ());
+        GST_PAD_STREAM_LOCK (sinkpad);
+        g_signal_handlers_disconnect_by_data(fakesink, this);
+        GST_PAD_STREAM_UNLOCK (sinkpad);
+        gst_object_unref (sinkpad);
+        gst_object_unref (fakesink);
+
+        GstElement *decodebin = gst_bin_get_by_name (GST_BIN (_pipeline), "decodebin");
+        g_signal_handlers_disconnect_by_data(decodebin, this);
+        gst_object_unref (decodebin);
+
+        _disposePipeline(_pipeline, _source.release(), _display, _context, _disposeWait);
+        _pipeline = nullptr;
     }
 
     _state = PipelineState::STOPPED;
 }
 
+void GstreamerPipeline::_abort() {
+    _stopPipeline();
+    _signalFinished();
+}
+
+void GstreamerPipeline::_onStateTimeout() {
+    static auto& timeouts = Metrics::counter("disupurei_pipeline_state_timeouts_total", "Pipelines that didn't preroll in time");
+
+    if (_state != PipelineState::PREROLLING) {
+        return;
+    }
+
+    timeouts.add();
+    qCWarning(lcPipeline) << "Pipeline didn't preroll within" << _stateTimeout << "ms, skipping" << _filename;
+    _abort();
+}
+
+void GstreamerPipeline::_onWatchdog() {
+    static auto& stalls = Metrics::counter("disupurei_pipeline_stalls_total", "Playing pipelines reset because frames stopped arriving");
+
+    if (_state != PipelineState::PLAYING) {
+        return;
+    }
+
+    quint64 progress = _progress;
+    if (progress != _lastProgressValue) {
+        _lastProgressValue = progress;
+        _lastProgress.start();
+        return;
+    }
+
+    if (_lastProgress.elapsed() > _stallTimeout) {
+        stalls.add();
+        qCWarning(lcPipeline) << "No frames for" << _lastProgress.elapsed() << "ms, resetting pipeline for" << _filename;
+        _abort();
+    }
+}
+
+void GstreamerPipeline::_onEos(int generation) {
+    if (generation != _generation || _state == PipelineState::STOPPED) {
+        return;
+    }
+
+    _stopPipeline();
+    _signalFinished();
+}
+
+void GstreamerPipeline::_onError(int generation) {
+    if (generation != _generation || _state == PipelineState::STOPPED) {
+        return;
+    }
+
+    _abort();
+}
+
+void GstreamerPipeline::videoOnly(GstElement *decodebin) {
+    g_signal_connect (decodebin, "autoplug-continue", G_CALLBACK (on_autoplug_continue), NULL);
+}
+
+// Runs on the streaming thread for every stream decodebin finds. Returning
+// false exposes the pad as it is, so an audio or subtitle stream gets no
+// parser or decoder and its pad stays unlinked like before.
+gboolean GstreamerPipeline::on_autoplug_continue (GstElement * decodebin, GstPad * pad, GstCaps * caps, gpointer data) {
+    Q_UNUSED(decodebin);
+    Q_UNUSED(pad);
+    Q_UNUSED(data);
+    static auto& skipped = Metrics::counter("disupurei_streams_skipped_total", "Audio and subtitle streams left undecoded");
+
+    if (gst_caps_get_size(caps) == 0) {
+        return TRUE;
+    }
+
+    static const char* unused[] = {"audio/", "text/", "subpicture/", "subtitle/", "closedcaption/", "application/x-ssa", "application/x-ass"};
+    const char* name = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+    for (auto prefix : unused) {
+        if (g_str_has_prefix(name, prefix)) {
+            skipped.add();
+            qCDebug(lcPipeline) << "Not decoding" << name << "stream";
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Runs on the streaming thread before any data reaches the tail, links the
+// first video stream to the size filter. A video larger than the screen
+// gets the screen's size in the filter when the decoder can scale to it.
+void GstreamerPipeline::on_pad_added (GstElement * decodebin, GstPad * pad, GstreamerPipeline * p) {
+    static auto& downscaled = Metrics::counter("disupurei_video_downscaled_total", "Videos the decoder scaled down to the screen");
+
+    GstCaps* caps = gst_pad_get_current_caps(pad);
+    if (caps == nullptr) {
+        caps = gst_pad_query_caps(pad, NULL);
+    }
+    GstStructure* structure = gst_caps_get_structure(caps, 0);
+    if (! g_str_has_prefix(gst_structure_get_name(structure), "video/")) {
+        gst_caps_unref(caps);
+        return;
+    }
+
+    int width = 0;
+    int height = 0;
+    gst_structure_get_int(structure, "width", &width);
+    gst_structure_get_int(structure, "height", &height);
+    gst_caps_unref(caps);
+
+    GstBin* bin = GST_BIN(GST_ELEMENT_PARENT(decodebin));
+    GstElement* sizefilter = gst_bin_get_by_name(bin, "sizefilter");
+    GstPad* sinkpad = gst_element_get_static_pad(sizefilter, "sink");
+    if (gst_pad_is_linked(sinkpad)) {
+        // only the first video stream is played
+        gst_object_unref(sinkpad);
+        gst_object_unref(sizefilter);
+        return;
+    }
+
+    p->_sourceWidth = width;
+    p->_sourceHeight = height;
+    int scaledWidth, scaledHeight;
+    bool scaled = p->_scaledSize(&scaledWidth, &scaledHeight);
+    // a decoder with a scaler follows later resizes too, even when the video
+    // fits for now
+    p->_scaling = _decoderCanScale(decodebin, pad, scaledWidth, scaledHeight);
+    if (scaled && p->_scaling) {
+        GstCaps* scaledCaps = gst_caps_from_string(qPrintable(QString(_scaledCaps).arg(scaledWidth).arg(scaledHeight)));
+        g_object_set(G_OBJECT(sizefilter), "caps", scaledCaps, NULL);
+        gst_caps_unref(scaledCaps);
+        downscaled.add();
+        qCDebug(lcPipeline) << "Decoding" << width << "x" << height << "video at" << scaledWidth << "x" << scaledHeight;
+    } else if (scaled) {
+        qCDebug(lcPipeline) << "Decoder can't scale" << width << "x" << height << "video, it is scaled when drawn";
+    }
+    gst_object_unref(sizefilter);
+
+    if (GST_PAD_LINK_FAILED(gst_pad_link(pad, sinkpad))) {
+        qCWarning(lcPipeline) << "Failed to link the decoded video";
+    }
+    gst_object_unref(sinkpad);
+}
+
+// fakesink proposes no metas of its own, without this the GL elements
+// upstream never attach a sync meta and frames arrive without a fence
+GstPadProbeReturn GstreamerPipeline::on_allocation_query (GstPad * pad, GstPadProbeInfo * info, gpointer data) {
+    GstQuery* query = GST_PAD_PROBE_INFO_QUERY(info);
+    if (GST_QUERY_TYPE(query) == GST_QUERY_ALLOCATION) {
+        gst_query_add_allocation_meta(query, GST_GL_SYNC_META_API_TYPE, NULL);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// runs in the GStreamer GL context
+static void _finishGL(GstGLContext* context, gpointer) {
+    typedef void (GSTGLAPI *Finish)(void);
+    Finish finish = (Finish) gst_gl_context_get_proc_address(context, "glFinish");
+    if (finish != nullptr) {
+        finish();
+    }
+}
+
 /* fakesink handoff callback */
 void GstreamerPipeline::on_gst_buffer (GstElement * element, GstBuffer * buf, GstPad * pad, GstreamerPipeline * p) {
-    GstVideoFrame v_frame;
+    static auto& frames = Metrics::counter("disupurei_video_frames_total", "Video frames handed to the renderer");
+    static auto& lateFrames = Metrics::counter("disupurei_video_frames_late_total", "Video frames that reached the renderer more than one frame interval late");
+
     GstVideoInfo v_info;
-    GstVideoMeta *v_meta;
-    guint texture = 0;
 
-    v_meta = gst_buffer_get_video_meta (buf);
-    gst_video_info_set_format (&v_info, v_meta->format, v_meta->width, v_meta->height);
+    // the sink renders every frame, a frame is as good as dropped when it shows up a whole interval late
+    frames.add();
+    GstClock* clock = gst_element_get_clock(element);
+    if (clock != nullptr) {
+        GstClockTime runningTime = gst_segment_to_running_time(&GST_BASE_SINK(element)->segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buf));
+        GstClockTime now = gst_clock_get_time(clock) - gst_element_get_base_time(element);
+        GstClockTime interval = GST_BUFFER_DURATION_IS_VALID(buf) ? GST_BUFFER_DURATION(buf) : 40 * GST_MSECOND;
+        if (GST_CLOCK_TIME_IS_VALID(runningTime) && now > runningTime + interval) {
+            lateFrames.add();
+        }
+        gst_object_unref(clock);
+    }
+    p->_progress++;
+
+    // the colour matrix and range are only in the caps
+    GstCaps* caps = gst_pad_get_current_caps(pad);
+    bool parsed = caps != nullptr && gst_video_info_from_caps(&v_info, caps);
+    if (caps != nullptr) {
+        gst_caps_unref(caps);
+    }
+    if (! parsed) {
+        qCWarning(lcPipeline, "Buffer without video caps");
+        return;
+    }
 
-    if (!gst_video_frame_map (&v_frame, &v_info, buf, (GstMapFlags) (GST_MAP_READ | GST_MAP_GL))) {
-      g_warning ("Failed to map the video buffer");
+    GstVideoFrame* v_frame = new GstVideoFrame;
+    if (!gst_video_frame_map (v_frame, &v_info, buf, (GstMapFlags) (GST_MAP_READ | GST_MAP_GL))) {
+      qCWarning(lcPipeline, "Failed to map the video buffer");
+      delete v_frame;
       return;
     }
-    texture = *(guint *) v_frame.data[0];
 
-    p->notifyNewFrame(texture);
-    gst_video_frame_unmap (&v_frame);
+    // the renderer holds on to the buffer until it has drawn something newer,
+    // the streaming thread goes on with the next frame meanwhile
+    gst_buffer_ref(buf);
+    std::shared_ptr<void> mapping(v_frame, [buf](void* mapped) {
+        gst_video_frame_unmap(static_cast<GstVideoFrame*>(mapped));
+        delete static_cast<GstVideoFrame*>(mapped);
+        gst_buffer_unref(buf);
+    });
+
+    // glcolorconvert passes NV12 and I420 through, the planes go to the draw shader as they are
+    VideoFrame frame;
+    switch (GST_VIDEO_INFO_FORMAT(&v_info)) {
+    case GST_VIDEO_FORMAT_NV12:
+        frame.format = VideoFrame::Format::NV12;
+        break;
+    case GST_VIDEO_FORMAT_I420:
+        frame.format = VideoFrame::Format::I420;
+        break;
+    default:
+        frame.format = VideoFrame::Format::RGBA;
+        break;
+    }
+    for (guint plane = 0; plane < GST_VIDEO_INFO_N_PLANES(&v_info) && plane < 3; plane++) {
+        frame.textures[plane] = *(guint *) v_frame->data[plane];
+        // decoders pad planes to their alignment, the texture then has
+        // columns and rows past the picture
+        GstMemory* planeMemory = v_frame->map[plane].memory;
+        if (planeMemory != nullptr && gst_is_gl_memory(planeMemory)) {
+            frame.texScale[plane][0] = GST_GL_MEMORY_CAST(planeMemory)->tex_scaling[0];
+            frame.texScale[plane][1] = GST_GL_MEMORY_CAST(planeMemory)->tex_scaling[1];
+        }
+    }
+    frame.mapping = mapping;
+
+    // the upload and conversion may still be running on the GPU, the
+    // renderer waits on this fence in its own context instead of us
+    // waiting on the CPU
+    GstGLSyncMeta* syncMeta = gst_buffer_get_gl_sync_meta(buf);
+    GstMemory* memory = gst_buffer_peek_memory(buf, 0);
+    if (syncMeta != nullptr) {
+        if (syncMeta->data == nullptr && gst_is_gl_base_memory(memory)) {
+            gst_gl_sync_meta_set_sync_point(syncMeta, GST_GL_BASE_MEMORY_CAST(memory)->context);
+        }
+        frame.sync = syncMeta->data;
+    }
+    if (frame.sync == nullptr && gst_is_gl_base_memory(memory)) {
+        // no meta, or GL without fences: the streaming thread waits for the
+        // GStreamer context to finish before the frame is handed over
+        static auto& cpuWaits = Metrics::counter("disupurei_video_frames_cpu_synced_total", "Video frames waited for on the CPU because they carried no GL fence");
+        cpuWaits.add();
+        TRACE_SPAN("wait for upload");
+        gst_gl_context_thread_add(GST_GL_BASE_MEMORY_CAST(memory)->context, _finishGL, NULL);
+    }
+
+    gdouble kr, kb;
+    if (gst_video_color_matrix_get_Kr_Kb(v_info.colorimetry.matrix, &kr, &kb)) {
+        frame.kr = kr;
+        frame.kb = kb;
+    }
+    frame.fullRange = v_info.colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255;
+    frame.generation = p->_frameGeneration;
+
+    if (p->_awaitingFirstBuffer.exchange(false)) {
+        Trace::instant("first buffer");
+    }
+
+    p->notifyNewFrame(frame);
 }
 
-gboolean GstreamerPipeline::bus_call (GstBus * bus, GstMessage * msg, GstreamerPipeline * p) {
+// runs on the thread of the default main context, anything that touches
+// the pipeline is handed over to the pipeline thread
+gboolean GstreamerPipeline::bus_call (GstBus * bus, GstMessage * msg, BusWatch * watch) {
     Q_UNUSED (bus)
+    GstreamerPipeline* p = watch->pipeline;
 
     switch (GST_MESSAGE_TYPE (msg)) {
     case GST_MESSAGE_EOS:
         // qDebug ("End-of-stream received. Stopping.");
-        p->_stopPipeline();
-        p->_signalFinished();
+        emit p->eosReceived(watch->generation);
+        break;
+
+    case GST_MESSAGE_ASYNC_DONE:
+        emit p->asyncDoneReceived(watch->generation);
+        break;
+
+    case GST_MESSAGE_STATE_CHANGED:
+        if (GST_IS_PIPELINE (GST_MESSAGE_SRC (msg))) {
+            GstState oldState, newState;
+            gst_message_parse_state_changed (msg, &oldState, &newState, NULL);
+            qCDebug(lcPipeline) << "Pipeline" << gst_element_state_get_name(oldState) << "->" << gst_element_state_get_name(newState);
+        }
         break;
 
     case GST_MESSAGE_ERROR:
     {
+        static auto& errors = Metrics::counter("disupurei_pipeline_errors_total", "Errors posted by the video pipeline");
+        errors.add();
+
         gchar *debug = NULL;
         GError *err = NULL;
         gst_message_parse_error (msg, &err, &debug);
-        qDebug ("Error: %s", err->message);
+        qCWarning(lcPipeline, "Error: %s", err->message);
         g_error_free (err);
         if (debug) {
-            qDebug ("Debug deails: %s", debug);
+            qCDebug(lcPipeline, "Debug deails: %s", debug);
             g_free (debug);
         }
 
-        p->_stopPipeline();
+        emit p->errorReceived(watch->generation);
         break;
     }
 
@@ -269,6 +997,10 @@ gboolean GstreamerPipeline::bus_call (GstBus * bus, GstMessage * msg, GstreamerP
     return TRUE;
 }
 
+void GstreamerPipeline::bus_watch_free (gpointer watch) {
+    delete static_cast<BusWatch*>(watch);
+}
+
 gboolean GstreamerPipeline::sync_bus_call (GstBus * bus, GstMessage * msg, GstreamerPipeline * p) {
     Q_UNUSED(bus)
 
@@ -283,11 +1015,13 @@ gboolean GstreamerPipeline::sync_bus_call (GstBus * bus, GstMessage * msg, Gstre
             GstContext *display_context = gst_context_new (GST_GL_DISPLAY_CONTEXT_TYPE, TRUE);
             gst_context_set_gl_display (display_context, p->_display);
             gst_element_set_context (GST_ELEMENT (msg->src), display_context);
+            gst_context_unref (display_context);
         } else if (g_strcmp0 (context_type, "gst.gl.app_context") == 0) {
             GstContext *app_context = gst_context_new ("gst.gl.app_context", TRUE);
             GstStructure *s = gst_context_writable_structure (app_context);
             gst_structure_set (s, "context", GST_GL_TYPE_CONTEXT, p->_context, NULL);
             gst_element_set_context (GST_ELEMENT (msg->src), app_context);
+            gst_context_unref (app_context);
         }
         break;
     }
@@ -298,6 +1032,13 @@ gboolean GstreamerPipeline::sync_bus_call (GstBus * bus, GstMessage * msg, Gstre
     return FALSE;
 }
 
+void GstreamerPipeline::pipeline_finalized (gpointer data, GObject *pipeline) {
+    Q_UNUSED(data)
+    Q_UNUSED(pipeline)
+
+    _livePipelines--;
+}
+
 void GstreamerPipeline::_signalFinished() {
     emit finished();
 }
@@ -5,11 +5,18 @@
 #include <gst/gl/gstglcontext.h>
 #include <gst/gl/gstgldisplay.h>
 
+#include <QTimer>
 #include <QThread>
+#include <QElapsedTimer>
 #include <QOpenGLWidget>
 
 #include <QMutex>
-#include <QWaitCondition>
+
+#include <atomic>
+#include <memory>
+
+#include "mediasource.h"
+#include "videoframe.h"
 
 class GstreamerPipeline : public QObject
 {
@@ -18,21 +25,50 @@ public:
     GstreamerPipeline();
     ~GstreamerPipeline();
 
+    // how long prerolling may take, and how long a playing pipeline may go
+    // without a frame
+    static void timeouts(int stateMillis, int stallMillis);
+
+    // only the first call initializes, later ones return at once
+    static void initGstreamer(bool async);
+    static void waitForGstreamer();
+    static void shutdownGstreamer();
+
+    // leak accounting for the soak tools: pipelines not yet finalized, and
+    // pipelines that still had other references when they were released
+    static int livePipelines();
+    static int strayReferences();
+    // audio and subtitle streams stop at the demuxer, nothing parses or decodes them
+    static void videoOnly(GstElement* decodebin);
+
     void initialize(QOpenGLContext *context);
-    void open(const QString& filename) { emit openFileRequested(filename); }
-    void notifyNewFrame(GLuint texture);
-    void frameDrawn();
-    void stop();
+    // with a start time, the pipeline runs on the sync clock and shows its
+    // first frame when that clock reaches it. Returns the generation the
+    // frames decoded from this file carry.
+    int open(const QString& filename, quint64 startTime = GST_CLOCK_TIME_NONE);
+    void notifyNewFrame(const VideoFrame& frame);
+    void stop() { emit stopRequested(); }
+    // pixel size on screen, a decoder that can scale delivers larger video
+    // at this size, otherwise the renderer scales it down when drawing
+    void targetSize(int width, int height);
 signals:
     void finished();
-    void newFrameReady(GLuint texture);
+    void newFrameReady(const VideoFrame& frame);
     void videoSize(int width, int height);
+    void durationChanged(qint64 millis);
 
-    void openFileRequested(const QString& filename);
+    void openFileRequested(const QString& filename, quint64 startTime, int frameGeneration);
+    void stopRequested();
+    void resizeRequested();
+
+    void asyncDoneReceived(int generation);
+    void eosReceived(int generation);
+    void errorReceived(int generation);
 public slots:
 private:
     enum class PipelineState {
         STOPPED,
+        PREROLLING,
         PAUSED,
         PLAYING
     };
@@ -40,28 +76,66 @@ private:
     QThread _thread;
 
     QMutex _mutex;
-    QWaitCondition _wait;
+
+    struct BusWatch {
+        GstreamerPipeline* pipeline;
+        int generation;
+    };
 
     PipelineState _state = PipelineState::STOPPED;
+    int _generation = 0;
+    std::atomic<int> _opened{0};
+    std::atomic<int> _frameGeneration{0};
+    QString _filename;
+    GstClockTime _startTime = GST_CLOCK_TIME_NONE;
+    bool _flushing = false;
+    int _disposeWait = 0;
+
+    QTimer _stateTimer;
+    QTimer _watchdog;
+    QElapsedTimer _lastProgress;
+    std::atomic<quint64> _progress{0};
+    quint64 _lastProgressValue = 0;
+    std::atomic<bool> _awaitingFirstBuffer{false};
+    std::atomic<int> _targetWidth{0};
+    std::atomic<int> _targetHeight{0};
+    std::atomic<int> _sourceWidth{0};
+    std::atomic<int> _sourceHeight{0};
+    std::atomic<bool> _scaling{false};
     GstBus* m_bus;
 
     GstPipeline* _pipeline = nullptr;
-    GstElement* _filesrc = nullptr;
+    std::unique_ptr<MediaSource> _source;
     GstElement* _glupload = nullptr;
 
-    GstGLDisplay* _display;
-    GstGLContext* _context;
+    GstGLDisplay* _display = nullptr;
+    GstGLContext* _context = nullptr;
 
+    static GstPadProbeReturn on_allocation_query(GstPad * pad, GstPadProbeInfo * info, gpointer data);
     static void on_gst_buffer(GstElement * element, GstBuffer * buf, GstPad * pad, GstreamerPipeline* p);
-    static gboolean bus_call (GstBus *bus, GstMessage *msg, GstreamerPipeline* p);
+    static void on_pad_added(GstElement * decodebin, GstPad * pad, GstreamerPipeline* p);
+    static gboolean on_autoplug_continue(GstElement * decodebin, GstPad * pad, GstCaps * caps, gpointer data);
+    static gboolean bus_call (GstBus *bus, GstMessage *msg, BusWatch* watch);
+    static void bus_watch_free (gpointer watch);
     static gboolean sync_bus_call (GstBus *bus, GstMessage *msg, GstreamerPipeline* p);
+    static void pipeline_finalized (gpointer data, GObject *pipeline);
 
     void _signalFinished();
     void _startPipeline();
     void _pausePipeline();
     void _stopPipeline();
+    void _flush(bool flushing);
+    bool _scaledSize(int* width, int* height) const;
+    void _abort();
 private slots:
-    void _open(const QString& filename);
+    void _open(const QString& filename, quint64 startTime, int frameGeneration);
+    void _stop();
+    void _resize();
+    void _onAsyncDone(int generation);
+    void _onEos(int generation);
+    void _onError(int generation);
+    void _onStateTimeout();
+    void _onWatchdog();
 };
 
 #endif // GSTPIPELINE_H
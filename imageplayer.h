@@ -1,50 +1,40 @@
 #ifndef IMAGEPLAYER_H
 #define IMAGEPLAYER_H
 
-#include <memory>
+#include "gpustats.h"
+#include "imagerenderer.h"
 
 #include <QTimer>
+#include <QImage>
 #include <QOpenGLWidget>
-#include <QOpenGLFunctions>
-#include <QOpenGLBuffer>
-#include <QOpenGLTexture>
-#include <QOpenGLShaderProgram>
 
-class ImagePlayer : public QOpenGLWidget, protected QOpenGLFunctions {
+class ImagePlayer : public QOpenGLWidget {
     Q_OBJECT
 public:
     explicit ImagePlayer(QWidget *parent = 0);
     ~ImagePlayer();
 
-    void open(const QString& filename, int duration);
+    void open(const QString& filename, int duration, const QImage& image = QImage());
     void stop();
 signals:
     void timeout();
+    void framePresented();
 
 public slots:
 
 protected:
     void initializeGL() override;
     void paintGL() override;
-    void resizeGL(int width, int height) override;
 
 private:
     QTimer _timer;
-    QTimer _faderTimer;
-
-    QOpenGLBuffer _vbo;
-    QOpenGLTexture _texture;
-    std::unique_ptr<QOpenGLShaderProgram> _program;
+    ImageRenderer _renderer;
+    GpuFrameTimer _frameTimer;
 
     int _duration = 0;
-    float _fader = 1.0f;
-    float _fade_time = 2500.0f;
-    qint64 _fade_start = 0;
-    bool _fade_dir = false;
-    void _makeObject();
-private slots:
-    void _fade();
-    void _timeout();
+    bool _playing = false;
+    QString _pendingFile;
+    QImage _pendingImage;
 };
 
 #endif // IMAGEPLAYER_H
@@ -0,0 +1,149 @@
+#include "imagerenderer.h"
+#include "metrics.h"
+#include "shadercache.h"
+#include "trace.h"
+
+#include <QOpenGLContext>
+
+#define PROGRAM_VERTEX_ATTRIBUTE 0
+#define PROGRAM_TEXCOORD_ATTRIBUTE 1
+
+ImageRenderer::ImageRenderer() : _texture(QOpenGLTexture::Target2D) {
+    _texture.setAutoMipMapGenerationEnabled(false);
+}
+
+void ImageRenderer::initialize(QOpenGLContext *context) {
+    initializeOpenGLFunctions();
+    _makeObject();
+
+    const char *vsrc =
+            "attribute highp vec4 vertex;\n"
+            "attribute mediump vec4 texCoord;\n"
+            "varying mediump vec4 texc;\n"
+            "uniform mediump mat4 matrix;\n"
+            "void main(void)\n"
+            "{\n"
+            "    gl_Position = matrix * vertex;\n"
+            "    texc = texCoord;\n"
+            "}\n";
+
+    const char *fsrc =
+            "uniform sampler2D texture;\n"
+            "uniform mediump float fader;\n"
+            "varying mediump vec4 texc;\n"
+            "void main(void)\n"
+            "{\n"
+            "    gl_FragColor = mix(texture2D(texture, texc.st), vec4(1.0, 1.0, 1.0, 1.0), fader);\n"
+            "}\n";
+
+    _program = std::unique_ptr<QOpenGLShaderProgram>(new QOpenGLShaderProgram);
+    _program->bindAttributeLocation("vertex", PROGRAM_VERTEX_ATTRIBUTE);
+    _program->bindAttributeLocation("texCoord", PROGRAM_TEXCOORD_ATTRIBUTE);
+    ShaderCache(context).link(*_program, vsrc, fsrc);
+
+    _program->bind();
+    _program->setUniformValue("texture", 0);
+}
+
+void ImageRenderer::cleanup() {
+    _texture.destroy();
+    _program.reset();
+    _vbo.destroy();
+    _clock.invalidate();
+}
+
+void ImageRenderer::open(const QImage &image, int durationMillis) {
+    static auto& textureBytes = Metrics::gauge("disupurei_image_texture_bytes", "Size of the image texture on screen");
+
+    _texture.destroy();
+    _texture.setData(image);
+    textureBytes.set(_texture.isCreated() ? 4.0 * _texture.width() * _texture.height() : 0);
+
+    _duration = durationMillis;
+    _clock.start();
+}
+
+bool ImageRenderer::render() {
+    TRACE_SPAN("ImageRenderer::render");
+
+    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    QMatrix4x4 m;
+    _program->bind();
+    _program->setUniformValue("matrix", m);
+    _vbo.bind();
+    _program->enableAttributeArray(PROGRAM_VERTEX_ATTRIBUTE);
+    _program->enableAttributeArray(PROGRAM_TEXCOORD_ATTRIBUTE);
+    _program->setAttributeBuffer(PROGRAM_VERTEX_ATTRIBUTE, GL_FLOAT, 0, 3, 5 * sizeof(GLfloat));
+    _program->setAttributeBuffer(PROGRAM_TEXCOORD_ATTRIBUTE, GL_FLOAT, 3 * sizeof(GLfloat), 2, 5 * sizeof(GLfloat));
+    _program->setUniformValue("fader", _fader());
+
+    glActiveTexture(GL_TEXTURE0);
+    _texture.bind();
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    return _texture.isCreated();
+}
+
+bool ImageRenderer::finished() const {
+    return _clock.isValid() && _clock.elapsed() >= 2 * fadeMillis + _duration;
+}
+
+int ImageRenderer::nextFrameMillis() const {
+    if (! _clock.isValid() || finished()) {
+        return -1;
+    }
+
+    qint64 elapsed = _clock.elapsed();
+    if (elapsed >= fadeMillis && elapsed < fadeMillis + _duration) {
+        // nothing changes on screen until the fade out begins
+        return qMax<qint64>(1, fadeMillis + _duration - elapsed);
+    }
+    return 1000 / 60;
+}
+
+// 1 is all white, 0 the plain image
+float ImageRenderer::_fader() const {
+    if (! _clock.isValid()) {
+        return 1.0f;
+    }
+
+    qint64 elapsed = _clock.elapsed();
+    if (elapsed < fadeMillis) {
+        return 1.0f - (float) elapsed / fadeMillis;
+    }
+    elapsed -= fadeMillis + _duration;
+    if (elapsed < 0) {
+        return 0.0f;
+    }
+    return qMin(1.0f, (float) elapsed / fadeMillis);
+}
+
+void ImageRenderer::_makeObject() {
+    static const GLfloat coords[6][3] =
+        { { -1.0f, -1.0f,  0.0f },
+          {  1.0f, -1.0f,  0.0f },
+          { -1.0f,  1.0f,  0.0f },
+          { -1.0f,  1.0f,  0.0f },
+          {  1.0f,  1.0f,  0.0f },
+          {  1.0f, -1.0f,  0.0f } };
+
+    QVector<GLfloat> vertData;
+    for (int i = 0; i < 6; i++) {
+        // vertex position
+        vertData.append(coords[i][0]);
+        vertData.append(coords[i][1]);
+        vertData.append(coords[i][2]);
+        // texture coordinate
+        vertData.append(coords[i][0] > 0 ? 1 : 0);
+        vertData.append(coords[i][1] > 0 ? 0 : 1);
+    }
+
+    if (! _vbo.isCreated()) {
+        _vbo.create();
+    }
+
+    _vbo.bind();
+    _vbo.allocate(vertData.constData(), vertData.count() * sizeof(GLfloat));
+}
@@ -0,0 +1,48 @@
+#ifndef IMAGERENDERER_H
+#define IMAGERENDERER_H
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+
+#include <memory>
+
+class QOpenGLContext;
+
+// Draws an image faded in from and out to white. The fade is computed from
+// the time since open(), so it looks the same however often render() is
+// called; nextFrameMillis() tells the caller when to draw again.
+class ImageRenderer : protected QOpenGLFunctions {
+public:
+    static const int fadeMillis = 2500;
+
+    ImageRenderer();
+
+    void initialize(QOpenGLContext* context);
+    void cleanup();
+
+    // uploads the texture, so the context must be current
+    void open(const QImage& image, int durationMillis);
+    // returns true when an image was drawn
+    bool render();
+
+    bool finished() const;
+    // -1 once the image has faded out
+    int nextFrameMillis() const;
+
+private:
+    QOpenGLBuffer _vbo;
+    QOpenGLTexture _texture;
+    std::unique_ptr<QOpenGLShaderProgram> _program;
+
+    QElapsedTimer _clock;
+    int _duration = 0;
+
+    float _fader() const;
+    void _makeObject();
+};
+
+#endif // IMAGERENDERER_H
@@ -0,0 +1,319 @@
+#include "logger.h"
+#include "metrics.h"
+
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QThread>
+#include <QDateTime>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+Q_LOGGING_CATEGORY(lcPipeline, "disupurei.pipeline")
+Q_LOGGING_CATEGORY(lcPlaylist, "disupurei.playlist")
+Q_LOGGING_CATEGORY(lcPlayer, "disupurei.player")
+Q_LOGGING_CATEGORY(lcPrefetch, "disupurei.prefetch")
+Q_LOGGING_CATEGORY(lcSource, "disupurei.source")
+Q_LOGGING_CATEGORY(lcShaders, "disupurei.shaders")
+Q_LOGGING_CATEGORY(lcStartup, "disupurei.startup")
+Q_LOGGING_CATEGORY(lcMetrics, "disupurei.metrics")
+Q_LOGGING_CATEGORY(lcTrace, "disupurei.trace")
+Q_LOGGING_CATEGORY(lcSync, "disupurei.sync")
+
+struct LogRecord {
+    qint64 time;
+    QtMsgType type;
+    const char* category;
+    QString thread;
+    QString message;
+};
+
+// Bounded multi producer queue (Vyukov), a slot is free for the producer
+// when its sequence equals the position, readable when it is position + 1.
+// A full ring drops the message rather than making the caller wait.
+class LogRing {
+public:
+    static const size_t capacity = 4096;
+
+    bool push(LogRecord&& record) {
+        size_t position = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = _slots[position & (capacity - 1)];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t) sequence - (intptr_t) position;
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.record = std::move(record);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // single consumer, the writer thread
+    bool pop(LogRecord& record) {
+        Slot& slot = _slots[_head & (capacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != _head + 1) {
+            return false;
+        }
+
+        record = std::move(slot.record);
+        slot.sequence.store(_head + capacity, std::memory_order_release);
+        _head++;
+        return true;
+    }
+
+    LogRing() {
+        for (size_t i = 0; i < capacity; i++) {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        LogRecord record;
+    };
+
+    Slot _slots[capacity];
+    std::atomic<size_t> _tail{0};
+    size_t _head = 0;
+};
+
+struct RateState {
+    qint64 windowStart = 0;
+    int count = 0;
+    int suppressed = 0;
+};
+
+static Logger::Options _options;
+static LogRing _ring;
+static std::thread _writer;
+static std::atomic<bool> _running(false);
+static std::atomic<quint64> _dropped(0);
+static std::mutex _wakeMutex;
+static std::condition_variable _wake;
+static QtMessageHandler _previousHandler = nullptr;
+
+static const char* _levelName(QtMsgType type) {
+    switch (type) {
+    case QtDebugMsg: return "debug";
+    case QtInfoMsg: return "info";
+    case QtWarningMsg: return "warning";
+    case QtCriticalMsg: return "critical";
+    case QtFatalMsg: return "fatal";
+    }
+    return "unknown";
+}
+
+static QByteArray _format(const LogRecord& record) {
+    QJsonObject line;
+    line["ts"] = QDateTime::fromMSecsSinceEpoch(record.time).toString("yyyy-MM-ddTHH:mm:ss.zzz");
+    line["level"] = _levelName(record.type);
+    line["category"] = record.category;
+    line["thread"] = record.thread;
+    line["msg"] = record.message;
+    return QJsonDocument(line).toJson(QJsonDocument::Compact) + '\n';
+}
+
+class LogWriter {
+public:
+    LogWriter() : _file(QDir(_options.directory).filePath("disupurei.log")) {
+        QDir().mkpath(_options.directory);
+        _file.open(QIODevice::WriteOnly | QIODevice::Append);
+    }
+
+    void write(const LogRecord& record) {
+        if (! _allow(record)) {
+            return;
+        }
+        _write(_format(record), record.type);
+    }
+
+    void tick(qint64 now) {
+        // report suppressed repeats once their window has passed
+        for (auto it = _rates.begin(); it != _rates.end(); ) {
+            if (now - it->windowStart < _options.windowSeconds * 1000) {
+                ++it;
+                continue;
+            }
+
+            if (it->suppressed > 0) {
+                LogRecord summary;
+                summary.time = now;
+                summary.type = QtInfoMsg;
+                summary.category = "disupurei.logger";
+                summary.message = QString("Suppressed %1 repeats of: %2").arg(it->suppressed).arg(it.key().section('\n', 1));
+                _write(_format(summary), summary.type);
+            }
+            it = _rates.erase(it);
+        }
+
+        quint64 dropped = _dropped.exchange(0);
+        if (dropped > 0) {
+            LogRecord summary;
+            summary.time = now;
+            summary.type = QtWarningMsg;
+            summary.category = "disupurei.logger";
+            summary.message = QString("Log queue full, dropped %1 messages").arg(dropped);
+            _write(_format(summary), summary.type);
+        }
+    }
+
+    void flush() {
+        _file.flush();
+    }
+
+private:
+    QFile _file;
+    QHash<QString, RateState> _rates;
+
+    bool _allow(const LogRecord& record) {
+        // the "Playing back" trail is info, every line of it matters
+        if (record.type == QtDebugMsg || record.type == QtInfoMsg) {
+            return true;
+        }
+
+        RateState& rate = _rates[QString(record.category) + '\n' + record.message];
+        if (rate.count == 0) {
+            rate.windowStart = record.time;
+        }
+        if (++rate.count <= _options.burst) {
+            return true;
+        }
+
+        rate.suppressed++;
+        return false;
+    }
+
+    void _write(const QByteArray& line, QtMsgType type) {
+        if (_options.console || type == QtCriticalMsg || type == QtFatalMsg) {
+            fputs(line.constData(), stderr);
+        }
+
+        if (! _file.isOpen()) {
+            return;
+        }
+
+        _file.write(line);
+        if (_file.size() >= _options.maxFileSize) {
+            _rotate();
+        }
+    }
+
+    // disupurei.log -> disupurei.log.1 -> ... -> disupurei.log.<maxFiles>
+    void _rotate() {
+        _file.close();
+
+        QString base = _file.fileName();
+        QFile::remove(QString("%1.%2").arg(base).arg(_options.maxFiles));
+        for (int i = _options.maxFiles - 1; i >= 1; i--) {
+            QFile::rename(QString("%1.%2").arg(base).arg(i), QString("%1.%2").arg(base).arg(i + 1));
+        }
+        if (_options.maxFiles > 0) {
+            QFile::rename(base, base + ".1");
+        } else {
+            QFile::remove(base);
+        }
+
+        _file.open(QIODevice::WriteOnly | QIODevice::Append);
+    }
+};
+
+static void _writerLoop() {
+    LogWriter writer;
+    LogRecord record;
+
+    for (;;) {
+        bool running = _running;
+        bool wrote = false;
+        while (_ring.pop(record)) {
+            writer.write(record);
+            wrote = true;
+        }
+
+        writer.tick(QDateTime::currentMSecsSinceEpoch());
+        if (wrote) {
+            writer.flush();
+        }
+
+        if (! running) {
+            break;
+        }
+
+        // producers notify without the lock, the timeout covers a missed wakeup
+        std::unique_lock<std::mutex> lock(_wakeMutex);
+        _wake.wait_for(lock, std::chrono::milliseconds(200));
+    }
+
+    writer.flush();
+}
+
+static void _messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& message) {
+    static auto& dropped = Metrics::counter("disupurei_log_dropped_total", "Log messages dropped because the queue was full");
+
+    if (type == QtFatalMsg) {
+        // the process aborts right after this, write it out directly
+        fprintf(stderr, "%s: %s\n", context.category ? context.category : "default", qPrintable(message));
+        return;
+    }
+
+    QString thread = QThread::currentThread()->objectName();
+    if (thread.isEmpty()) {
+        thread = QString("0x%1").arg((quintptr) QThread::currentThreadId(), 0, 16);
+    }
+
+    LogRecord record;
+    record.time = QDateTime::currentMSecsSinceEpoch();
+    record.type = type;
+    record.category = context.category ? context.category : "default";
+    record.thread = thread;
+    record.message = message;
+
+    if (! _ring.push(std::move(record))) {
+        _dropped++;
+        dropped.add();
+        return;
+    }
+
+    if (type >= QtWarningMsg) {
+        _wake.notify_one();
+    }
+}
+
+void Logger::install(const Options &options) {
+    if (_running) {
+        return;
+    }
+
+    _options = options;
+    _options.maxFiles = qMax(0, _options.maxFiles);
+    _options.maxFileSize = qMax(Q_INT64_C(64 * 1024), _options.maxFileSize);
+
+    _running = true;
+    _writer = std::thread(_writerLoop);
+    _previousHandler = qInstallMessageHandler(_messageHandler);
+}
+
+void Logger::shutdown() {
+    if (! _running) {
+        return;
+    }
+
+    qInstallMessageHandler(_previousHandler);
+    _running = false;
+    _wake.notify_one();
+    _writer.join();
+}
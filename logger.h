@@ -0,0 +1,39 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QString>
+#include <QLoggingCategory>
+
+Q_DECLARE_LOGGING_CATEGORY(lcPipeline)
+Q_DECLARE_LOGGING_CATEGORY(lcPlaylist)
+Q_DECLARE_LOGGING_CATEGORY(lcPlayer)
+Q_DECLARE_LOGGING_CATEGORY(lcPrefetch)
+Q_DECLARE_LOGGING_CATEGORY(lcSource)
+Q_DECLARE_LOGGING_CATEGORY(lcShaders)
+Q_DECLARE_LOGGING_CATEGORY(lcStartup)
+Q_DECLARE_LOGGING_CATEGORY(lcMetrics)
+Q_DECLARE_LOGGING_CATEGORY(lcTrace)
+Q_DECLARE_LOGGING_CATEGORY(lcSync)
+
+// Replaces the Qt message handler with one that never blocks the caller.
+// Messages are queued on a lock free ring and written as JSON lines by a
+// background thread to <directory>/disupurei.log, rotated by size. Repeats
+// of the same warning or worse are rate limited per category, levels per
+// category come from the regular QLoggingCategory filter rules.
+class Logger
+{
+public:
+    struct Options {
+        QString directory;
+        qint64 maxFileSize = 4 * 1024 * 1024;
+        int maxFiles = 5;
+        bool console = false;
+        int burst = 5;
+        int windowSeconds = 60;
+    };
+
+    static void install(const Options& options);
+    static void shutdown();
+};
+
+#endif // LOGGER_H
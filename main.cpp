@@ -39,9 +39,16 @@
 ****************************************************************************/
 
 #include <iostream>
+#include <memory>
+#include <vector>
 
+#include <QThread>
+#include <QDir>
 #include <QSettings>
+#include <QStandardPaths>
+#include <QLoggingCategory>
 #include <QApplication>
+#include <QScreen>
 #include <QSurfaceFormat>
 #include <QNetworkInterface>
 #include <QCommandLineParser>
@@ -49,6 +56,18 @@
 #include <gst/gst.h>
 
 #include "window.h"
+#include "decodeprobe.h"
+#include "gstpipeline.h"
+#include "logger.h"
+#include "mediacache.h"
+#include "mediasource.h"
+#include "playbacksurface.h"
+#include "metrics.h"
+#include "metricsserver.h"
+#include "processstats.h"
+#include "startupprofile.h"
+#include "syncclock.h"
+#include "trace.h"
 
 static QString mac() {
     for (const QNetworkInterface& netInterface : QNetworkInterface::allInterfaces()) {
@@ -60,6 +79,28 @@ static QString mac() {
     return QString();
 }
 
+struct Output {
+    QString mac;
+    int screen;
+};
+
+// outputs/<n>/mac and outputs/<n>/screen drive one window each, without
+// them a single window plays on the primary screen as mac
+static QVector<Output> outputs(QSettings& settings, const QString& macAddress) {
+    QVector<Output> result;
+    int count = settings.beginReadArray("outputs");
+    for (int i = 0; i < count; i++) {
+        settings.setArrayIndex(i);
+        result.append({settings.value("mac").toString(), settings.value("screen", i).toInt()});
+    }
+    settings.endArray();
+
+    if (result.isEmpty()) {
+        result.append({macAddress, -1});
+    }
+    return result;
+}
+
 static std::string red     = "\x1b[31;1m";
 static std::string green   = "\x1b[32;1m";
 static std::string yellow  = "\x1b[33;1m";
@@ -68,17 +109,20 @@ static std::string cyan    = "\x1b[36;1m";
 static std::string restore = "\x1b[0m\n";
 
 int main(int argc, char *argv[]) {
+    QThread::currentThread()->setObjectName("main");
+    StartupProfile::mark("main");
+
 #ifdef Q_OS_WIN
     QCoreApplication::setAttribute(Qt::AA_UseDesktopOpenGL);
     qputenv("GST_PLUGIN_PATH", "gstreamer");
 #endif
-	
-    gst_init (NULL, NULL);
+
     QApplication::setApplicationName("disupurei");
     QApplication::setApplicationVersion("0.1");
     QApplication::setOrganizationName("Carbonium Development");
     QApplication::setOrganizationDomain("https://github.com/jgilje/disupurei");
     QApplication app(argc, argv);
+    StartupProfile::mark("QApplication");
     QSettings settings;
 
     std::cout << yellow << std::endl <<
@@ -102,6 +146,7 @@ int main(int argc, char *argv[]) {
     QCommandLineOption urlOption = QCommandLineOption({{"u", "url"}, "Set server URL\n(clear value with '.' as arg.)", "url"});
     QCommandLineOption macOption = QCommandLineOption({{"m", "mac"}, "Set/Override mac address\n(clear value with '.' as arg.)", "mac"});
     QCommandLineOption windowOption = QCommandLineOption({{"w", "window"}, "Start in windowed mode"});
+    QCommandLineOption fastBootOption = QCommandLineOption({{"f", "fast-boot"}, "Overlap GStreamer, metadata and GL initialization"});
     parser.setApplicationDescription("disupurei - info screen client");
     parser.addHelpOption();
     parser.addVersionOption();
@@ -109,6 +154,7 @@ int main(int argc, char *argv[]) {
     parser.addOption(urlOption);
     parser.addOption(macOption);
     parser.addOption(windowOption);
+    parser.addOption(fastBootOption);
     parser.process(app);
 
     if (parser.isSet(configOption)) {
@@ -144,6 +190,55 @@ int main(int argc, char *argv[]) {
             std::cout << "\tMAC: " << magenta << qPrintable(mac()) << " (detected)" << std::endl;
         }
 
+        for (auto& output : outputs(settings, QString())) {
+            if (output.screen >= 0) {
+                std::cout << cyan << "\tOutput: " << magenta << "screen " << output.screen << " as " << qPrintable(output.mac) << std::endl;
+            }
+        }
+
+        std::cout << cyan << "\tFast boot: " << magenta << (settings.value("fastBoot", false).toBool() ? "on" : "off") << std::endl;
+
+        std::cout << cyan << "\tMetrics: " << magenta;
+        if (settings.value("metrics/port", 0).toInt() > 0) {
+            std::cout << "http://127.0.0.1:" << settings.value("metrics/port").toInt() << "/metrics ";
+        }
+        if (! settings.value("metrics/socket").toString().isEmpty()) {
+            std::cout << qPrintable(settings.value("metrics/socket").toString());
+        }
+        if (settings.value("metrics/port", 0).toInt() <= 0 && settings.value("metrics/socket").toString().isEmpty()) {
+            std::cout << "off";
+        }
+        std::cout << std::endl;
+
+        std::cout << cyan << "\tDecode probe: " << magenta;
+        bool decodeProbed;
+        QVector<DecodeLimit> decodeLimits = DecodeProbe::cachedLimits(&decodeProbed);
+        if (! settings.value("decode/probe", true).toBool()) {
+            std::cout << "off";
+        } else if (! decodeProbed) {
+            std::cout << "pending";
+        }
+        for (auto& limit : decodeLimits) {
+            std::cout << qPrintable(limit.codec) << " " << limit.height << "p" << limit.fps << " ";
+        }
+        std::cout << std::endl;
+
+        std::cout << cyan << "\tPush: " << magenta;
+        if (settings.value("push/enabled", false).toBool()) {
+            std::cout << "on, polling every " << settings.value("push/fallbackSeconds", 300).toInt() << " s";
+        } else {
+            std::cout << "off";
+        }
+        std::cout << std::endl;
+
+        std::cout << cyan << "\tRender backend: " << magenta << qPrintable(settings.value("render/backend", "widget").toString()) << std::endl;
+
+        std::cout << cyan << "\tSync: " << magenta << qPrintable(settings.value("sync/role", "off").toString());
+        if (! settings.value("sync/address").toString().isEmpty()) {
+            std::cout << " " << qPrintable(settings.value("sync/address").toString());
+        }
+        std::cout << std::endl;
+
         std::cout << restore;
         return 0;
     }
@@ -169,16 +264,170 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    DisupureiWindow window;
-    window.playlist().macAddress(macAddress);
-    window.playlist().url(url);
+    // rules use the QT_LOGGING_RULES syntax, separated by ';' in the config
+    QLoggingCategory::setFilterRules(settings.value("logging/rules", "*.debug=false").toString().replace(';', '\n'));
+    Logger::Options logOptions;
+    logOptions.directory = settings.value("logging/directory",
+        QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("logs")).toString();
+    logOptions.maxFileSize = settings.value("logging/maxSizeMB", 4).toLongLong() * 1024 * 1024;
+    logOptions.maxFiles = settings.value("logging/files", 5).toInt();
+    logOptions.console = settings.value("logging/console", false).toBool();
+    Logger::install(logOptions);
+    Trace::installSignalHandler(QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("traces"));
+
+    bool fastBoot = parser.isSet(fastBootOption) || settings.value("fastBoot", false).toBool();
+    StartupProfile::mark("settings");
+
+    bool sourceModeOk;
+    auto sourceMode = MediaSource::modeFromString(settings.value("source/mode", "default").toString(), &sourceModeOk);
+    if (! sourceModeOk) {
+        std::cout << red << "Unknown source/mode in config, using default." << restore << std::endl;
+    }
+    MediaSource::configure(sourceMode,
+                           settings.value("source/thresholdMB", 32).toLongLong() * 1024 * 1024,
+                           settings.value("source/blocksizeKB", 1024).toUInt() * 1024);
+
+    bool backendOk;
+    auto backend = PlaybackSurface::backendFromString(settings.value("render/backend", "widget").toString(), &backendOk);
+    if (! backendOk) {
+        std::cout << red << "Unknown render/backend in config, using widget." << restore << std::endl;
+    }
+    PlaybackSurface::configure(backend);
 
-    if (parser.isSet(windowOption)) {
-        window.show();
-    } else {
-        window.showFullScreen();
+    GstreamerPipeline::timeouts(settings.value("video/stateTimeoutMs", 10000).toInt(),
+                                settings.value("video/stallTimeoutMs", 5000).toInt());
+
+    // plugins are preloaded in the background, in fast boot mode the registry
+    // is also loaded while the window and GL are brought up
+    GstreamerPipeline::initGstreamer(fastBoot);
+
+    bool syncRoleOk;
+    auto syncRole = SyncClock::roleFromString(settings.value("sync/role", "off").toString(), &syncRoleOk);
+    if (! syncRoleOk) {
+        std::cout << red << "Unknown sync/role in config, sync is off." << restore << std::endl;
+    }
+    if (syncRole != SyncClock::Role::OFF) {
+        // the first entry is already scheduled on the shared clock
+        GstreamerPipeline::waitForGstreamer();
+        SyncClock::start(syncRole,
+                         settings.value("sync/address").toString(),
+                         settings.value("sync/port", 5637).toInt(),
+                         settings.value("sync/boundaryMs", 1000).toInt(),
+                         settings.value("sync/leadMs", 500).toInt());
+    }
+
+    MetricsServer metricsServer;
+    quint16 metricsPort = settings.value("metrics/port", 0).toUInt();
+    QString metricsSocket = settings.value("metrics/socket").toString();
+    if (metricsPort > 0) {
+        metricsServer.listen(metricsPort);
+    }
+    if (! metricsSocket.isEmpty()) {
+        metricsServer.listen(metricsSocket);
+    }
+    Metrics::collector([] {
+        static auto& rss = Metrics::gauge("disupurei_process_resident_bytes", "Resident set size of the process");
+        static auto& cpu = Metrics::gauge("disupurei_process_cpu_seconds", "User and system CPU time consumed by the process");
+        rss.set(ProcessStats::residentBytes());
+        cpu.set(ProcessStats::cpuSeconds());
+    });
+
+    QVector<Output> configuredOutputs = outputs(settings, macAddress);
+    for (auto& output : configuredOutputs) {
+        if (output.mac.isEmpty()) {
+            std::cout << red << "Output for screen " << output.screen << " has no mac address set." << restore << std::endl;
+            return 1;
+        }
+    }
+
+    // one media cache for every output, an asset on several screens is downloaded and stored once
+    QDir cacheDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+    auto mediaCache = std::make_shared<MediaCache>();
+    mediaCache->path(cacheDir.filePath("entries"));
+
+    QList<QScreen*> screens = QGuiApplication::screens();
+    std::vector<std::unique_ptr<DisupureiWindow>> windows;
+    for (auto& output : configuredOutputs) {
+        QScreen* screen = QGuiApplication::primaryScreen();
+        if (output.screen >= screens.size()) {
+            std::cout << red << "No screen " << output.screen << ", " << qPrintable(output.mac) << " plays on the primary screen." << restore << std::endl;
+        } else if (output.screen >= 0) {
+            screen = screens.at(output.screen);
+        }
+
+        std::unique_ptr<DisupureiWindow> window(new DisupureiWindow);
+        if (output.screen >= 0) {
+            // sequence metadata is per identity, media is shared
+            QString identity = output.mac;
+            window->playlist().cachePath(cacheDir.filePath(QString("outputs/%1").arg(identity.replace(':', '-'))));
+        }
+        window->playlist().mediaCache(mediaCache);
+        window->playlist().screenSize(screen->size());
+        window->playlist().macAddress(output.mac);
+        window->playlist().url(url);
+        if (settings.value("push/enabled", false).toBool()) {
+            window->playlist().push(settings.value("push/fallbackSeconds", 300).toInt() * 1000);
+        }
+        window->fastBoot(fastBoot);
+        window->prefetcher().depth(settings.value("prefetch/depth", 2).toInt());
+        window->prefetcher().budget(settings.value("prefetch/budgetMB", 64).toLongLong() * 1024 * 1024 / configuredOutputs.size());
+        window->supervisor().timeouts(settings.value("supervisor/firstFrameMs", 15000).toInt(),
+                                      settings.value("supervisor/graceMs", 10000).toInt(),
+                                      settings.value("supervisor/maxVideoMinutes", 30).toInt() * 60 * 1000);
+        window->supervisor().restartEnabled(settings.value("supervisor/restart", true).toBool());
+        if (parser.isSet(windowOption)) {
+            window->move(screen->geometry().topLeft());
+        } else {
+            window->setGeometry(screen->geometry());
+        }
+        windows.push_back(std::move(window));
+    }
+    StartupProfile::mark("window");
+
+    // limits found by an earlier probe apply right away. A first probe runs
+    // once the first frame is on screen, its encodes and decodes would
+    // otherwise hold up startup and compete for the hardware decoder. Its
+    // limits make every playlist read its sequence again, on the GUI thread.
+    std::unique_ptr<DecodeProbe> decodeProbe;
+    if (settings.value("decode/probe", true).toBool()) {
+        bool decodeProbed;
+        QVector<DecodeLimit> decodeLimits = DecodeProbe::cachedLimits(&decodeProbed);
+        for (auto& window : windows) {
+            window->playlist().decodeLimits(decodeLimits);
+        }
+
+        if (! decodeProbed && ! windows.empty()) {
+            decodeProbe = std::unique_ptr<DecodeProbe>(new DecodeProbe);
+            DecodeProbe* probe = decodeProbe.get();
+            QObject::connect(probe, &DecodeProbe::finished, &app, [&windows] {
+                QVector<DecodeLimit> limits = DecodeProbe::cachedLimits(nullptr);
+                for (auto& window : windows) {
+                    window->playlist().decodeLimits(limits);
+                }
+            });
+
+            auto firstFrame = std::make_shared<QMetaObject::Connection>();
+            *firstFrame = QObject::connect(windows.front().get(), &DisupureiWindow::framePresented, &app, [probe, firstFrame] {
+                QObject::disconnect(*firstFrame);
+                probe->run();
+            });
+        }
+    }
+
+    for (auto& window : windows) {
+        if (parser.isSet(windowOption)) {
+            window->show();
+        } else {
+            window->showFullScreen();
+        }
     }
+    StartupProfile::mark("show");
 
-    return app.exec();
-    gst_deinit();
+    int result = app.exec();
+    decodeProbe.reset();
+    windows.clear();
+    SyncClock::stop();
+    GstreamerPipeline::shutdownGstreamer();
+    Logger::shutdown();
+    return result;
 }
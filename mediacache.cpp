@@ -0,0 +1,114 @@
+#include "mediacache.h"
+#include "logger.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <QtNetwork/QNetworkReply>
+
+static const char* _posterSuffix = ".poster.jpg";
+
+MediaCache::MediaCache(QObject *parent) : QObject(parent) {
+}
+
+QString MediaCache::posterPath(const QString &filePath) {
+    return filePath + _posterSuffix;
+}
+
+void MediaCache::path(const QString &path) {
+    _path.setPath(path);
+    if (! _path.exists()) {
+        _path.mkpath(".");
+    }
+}
+
+QString MediaCache::filePath(const QString &key) const {
+    return _path.filePath(key);
+}
+
+bool MediaCache::contains(const QString &key) const {
+    return QFile::exists(_path.filePath(key));
+}
+
+void MediaCache::fetch(const QString &key, const QUrl &url) {
+    // another playlist is already downloading it, it gets the same notification
+    if (_downloadClocks.contains(key)) {
+        return;
+    }
+
+    qCDebug(lcPlaylist) << "Downloading" << url;
+    _downloadClocks[key].start();
+    Trace::asyncBegin("download", qHash(key));
+    auto reply = _nam.get(QNetworkRequest(url));
+    _downloads.insert(reply, key);
+    connect(reply, &QNetworkReply::finished, this, &MediaCache::_onFetchFinished);
+}
+
+void MediaCache::attach(QObject *owner) {
+    _unclaimed.insert(owner);
+}
+
+void MediaCache::detach(QObject *owner) {
+    _unclaimed.remove(owner);
+    _claims.remove(owner);
+}
+
+void MediaCache::claim(QObject *owner, const QSet<QString> &keys) {
+    _claims[owner] = keys;
+    _unclaimed.remove(owner);
+
+    _cleanup();
+}
+
+void MediaCache::_cleanup() {
+    // a playlist that hasn't read its sequence yet may still want anything
+    if (! _unclaimed.isEmpty()) {
+        return;
+    }
+
+    QSet<QString> files = _path.entryList({}, QDir::Files).toSet();
+    for (auto& keys : _claims) {
+        files.subtract(keys);
+        for (auto& key : keys) {
+            files.remove(key + _posterSuffix);
+        }
+    }
+    for (auto& key : _downloadClocks.keys()) {
+        files.remove(key);
+    }
+
+    for (auto& staleEntry : files) {
+        QFile fileEntry(_path.filePath(staleEntry));
+        fileEntry.remove();
+
+        qCInfo(lcPlaylist) << "Removed stale entry" << fileEntry.fileName();
+    }
+}
+
+void MediaCache::_onFetchFinished() {
+    static auto& downloadBytes = Metrics::counter("disupurei_download_bytes_total", "Bytes of media downloaded");
+    static auto& downloadFailures = Metrics::counter("disupurei_download_failures_total", "Media downloads that failed");
+    static auto& downloadDuration = Metrics::histogram("disupurei_download_duration_seconds", "Time to download one media file",
+                                                       {0.1, 0.5, 1, 2.5, 5, 10, 30, 60, 120, 300});
+
+    auto reply = qobject_cast<QNetworkReply*>(sender());
+    reply->deleteLater();
+    QString key = _downloads.take(reply);
+    QElapsedTimer clock = _downloadClocks.take(key);
+    Trace::asyncEnd("download", qHash(key));
+
+    if (reply->error() != QNetworkReply::NoError) {
+        downloadFailures.add();
+        qCWarning(lcPlaylist) << "Failed to download item at url" << reply->url();
+        emit fetched(key, false);
+        return;
+    }
+
+    QFile entryFile(_path.filePath(key));
+    entryFile.open(QIODevice::WriteOnly);
+    qint64 written = entryFile.write(reply->readAll());
+    entryFile.close();
+    downloadBytes.add(qMax(Q_INT64_C(0), written));
+    downloadDuration.observe(clock.elapsed() / 1000.0);
+
+    emit fetched(key, written >= 0);
+}
@@ -0,0 +1,52 @@
+#ifndef MEDIACACHE_H
+#define MEDIACACHE_H
+
+#include <QObject>
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QUrl>
+#include <QtNetwork/QNetworkAccessManager>
+
+// Sequence media on disk, shared by every playlist in the process. A file
+// is downloaded once no matter how many playlists ask for it. Files are
+// only removed once every attached playlist has claimed its entries, and
+// then only those no playlist claims. A video's poster frame is stored
+// next to it and lives as long as the video does.
+class MediaCache : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MediaCache(QObject *parent = 0);
+
+    static QString posterPath(const QString& filePath);
+
+    void path(const QString& path);
+    QString filePath(const QString& key) const;
+    bool contains(const QString& key) const;
+
+    void fetch(const QString& key, const QUrl& url);
+
+    void attach(QObject* owner);
+    void detach(QObject* owner);
+    void claim(QObject* owner, const QSet<QString>& keys);
+
+signals:
+    void fetched(const QString& key, bool ok);
+
+private:
+    QDir _path;
+    QNetworkAccessManager _nam;
+    QHash<QNetworkReply*, QString> _downloads;
+    QHash<QString, QElapsedTimer> _downloadClocks;
+    QHash<QObject*, QSet<QString>> _claims;
+    QSet<QObject*> _unclaimed;
+
+    void _cleanup();
+private slots:
+    void _onFetchFinished();
+};
+
+#endif // MEDIACACHE_H
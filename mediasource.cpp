@@ -0,0 +1,222 @@
+#include "mediasource.h"
+#include "logger.h"
+
+#include <initializer_list>
+
+#include <QFile>
+#include <QFileInfo>
+
+#include <QDebug>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static MediaSource::Mode _defaultMode = MediaSource::Mode::DEFAULT;
+static qint64 _defaultThreshold = 0;
+static guint _defaultBlocksize = 4096;
+
+#ifdef Q_OS_UNIX
+struct Mapping {
+    void* data;
+    gsize size;
+};
+
+static void _unmap(gpointer user_data) {
+    Mapping* mapping = static_cast<Mapping*>(user_data);
+    munmap(mapping->data, mapping->size);
+    delete mapping;
+}
+#endif
+
+void MediaSource::configure(MediaSource::Mode mode, qint64 threshold, guint blocksize) {
+    _defaultMode = mode;
+    _defaultThreshold = threshold;
+    _defaultBlocksize = blocksize;
+}
+
+MediaSource::Mode MediaSource::modeFromString(const QString &mode, bool *ok) {
+    for (auto candidate : {Mode::DEFAULT, Mode::BLOCKSIZE, Mode::READAHEAD, Mode::MMAP}) {
+        if (mode.compare(modeName(candidate), Qt::CaseInsensitive) == 0) {
+            *ok = true;
+            return candidate;
+        }
+    }
+
+    *ok = false;
+    return Mode::DEFAULT;
+}
+
+const char *MediaSource::modeName(MediaSource::Mode mode) {
+    switch (mode) {
+    case Mode::DEFAULT:
+        return "default";
+    case Mode::BLOCKSIZE:
+        return "blocksize";
+    case Mode::READAHEAD:
+        return "readahead";
+    case Mode::MMAP:
+        return "mmap";
+    }
+
+    return "default";
+}
+
+MediaSource::MediaSource(const QString &filename) :
+    _mode(_defaultMode), _blocksize(_defaultBlocksize), _offset(0) {
+    if (QFileInfo(filename).size() < _defaultThreshold) {
+        _mode = Mode::DEFAULT;
+    }
+
+    _create(filename);
+}
+
+MediaSource::MediaSource(const QString &filename, MediaSource::Mode mode, guint blocksize) :
+    _mode(mode), _blocksize(blocksize), _offset(0) {
+    _create(filename);
+}
+
+MediaSource::~MediaSource() {
+    if (_element != nullptr) {
+        gst_object_unref(_element);
+    }
+
+    // outstanding buffers keep the mapping alive, it is unmapped with the last of them
+    if (_mapping != nullptr) {
+        gst_buffer_unref(_mapping);
+    }
+
+#ifdef Q_OS_UNIX
+    if (_fd >= 0) {
+        close(_fd);
+    }
+#endif
+}
+
+GstElement *MediaSource::element() const {
+    return _element;
+}
+
+MediaSource::Mode MediaSource::mode() const {
+    return _mode;
+}
+
+void MediaSource::_create(const QString &filename) {
+    if (_mode == Mode::READAHEAD && ! _createReadahead(filename)) {
+        _mode = Mode::BLOCKSIZE;
+    }
+
+    if (_mode == Mode::MMAP && ! _createMapped(filename)) {
+        _mode = Mode::BLOCKSIZE;
+    }
+
+    if (_element == nullptr) {
+        QByteArray location = QFile::encodeName(filename);
+        _element = gst_element_factory_make("filesrc", "filesrc");
+        g_object_set(_element, "location", location.constData(), NULL);
+        if (_mode == Mode::BLOCKSIZE) {
+            g_object_set(_element, "blocksize", _blocksize, NULL);
+        }
+    }
+
+    gst_object_ref_sink(_element);
+}
+
+bool MediaSource::_createReadahead(const QString &filename) {
+#ifdef Q_OS_UNIX
+    _fd = open(QFile::encodeName(filename).constData(), O_RDONLY | O_CLOEXEC);
+    if (_fd < 0) {
+        qCWarning(lcSource) << Q_FUNC_INFO << "Failed to open" << filename;
+        return false;
+    }
+
+    posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    _element = gst_element_factory_make("fdsrc", "filesrc");
+    g_object_set(_element, "fd", _fd, "blocksize", _blocksize, NULL);
+    return true;
+#else
+    Q_UNUSED(filename)
+    return false;
+#endif
+}
+
+bool MediaSource::_createMapped(const QString &filename) {
+#ifdef Q_OS_UNIX
+    int fd = open(QFile::encodeName(filename).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        qCWarning(lcSource) << Q_FUNC_INFO << "Failed to open" << filename;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    _size = info.st_size;
+    void* data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        qCWarning(lcSource) << Q_FUNC_INFO << "Failed to map" << filename;
+        return false;
+    }
+
+    madvise(data, _size, MADV_SEQUENTIAL);
+    _mapping = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, data, _size, 0, _size,
+                                           new Mapping{data, _size}, _unmap);
+
+    // stream-type 1 is GST_APP_STREAM_TYPE_SEEKABLE, demuxers may still seek to the index
+    _element = gst_element_factory_make("appsrc", "filesrc");
+    g_object_set(_element,
+                 "stream-type", 1,
+                 "format", GST_FORMAT_BYTES,
+                 "size", (gint64) _size,
+                 NULL);
+    g_signal_connect(_element, "need-data", G_CALLBACK(_needData), this);
+    g_signal_connect(_element, "seek-data", G_CALLBACK(_seekData), this);
+    return true;
+#else
+    Q_UNUSED(filename)
+    return false;
+#endif
+}
+
+void MediaSource::_needData(GstElement *appsrc, guint length, MediaSource *source) {
+    guint64 offset = source->_offset;
+    GstFlowReturn ret;
+
+    if (offset >= source->_size) {
+        g_signal_emit_by_name(appsrc, "end-of-stream", &ret);
+        return;
+    }
+
+    gsize size = source->_blocksize;
+    if (length != (guint) -1 && length > size) {
+        size = length;
+    }
+    size = MIN(size, source->_size - offset);
+
+    // shares the mapped memory, nothing is copied
+    GstBuffer* buffer = gst_buffer_copy_region(source->_mapping, GST_BUFFER_COPY_MEMORY, offset, size);
+    GST_BUFFER_OFFSET(buffer) = offset;
+    source->_offset = offset + size;
+
+    g_signal_emit_by_name(appsrc, "push-buffer", buffer, &ret);
+    gst_buffer_unref(buffer);
+}
+
+gboolean MediaSource::_seekData(GstElement *appsrc, guint64 offset, MediaSource *source) {
+    Q_UNUSED(appsrc)
+
+    if (offset > source->_size) {
+        return FALSE;
+    }
+
+    source->_offset = offset;
+    return TRUE;
+}
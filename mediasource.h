@@ -0,0 +1,55 @@
+#ifndef MEDIASOURCE_H
+#define MEDIASOURCE_H
+
+#include <gst/gst.h>
+
+#include <QString>
+
+#include <atomic>
+
+// Source element for a local media file. Files at or above the configured
+// threshold use the configured mode, smaller ones a plain filesrc.
+//
+//  DEFAULT    filesrc with GStreamer's default block size
+//  BLOCKSIZE  filesrc with a larger block size
+//  READAHEAD  fdsrc on a descriptor opened with POSIX_FADV_SEQUENTIAL,
+//             which doubles the kernel readahead window for it
+//  MMAP       appsrc handing out read-only GstBuffers that wrap a single
+//             mmap() of the file, no copies between page cache and demuxer
+class MediaSource
+{
+public:
+    enum class Mode {
+        DEFAULT, BLOCKSIZE, READAHEAD, MMAP
+    };
+
+    static void configure(Mode mode, qint64 threshold, guint blocksize);
+    static Mode modeFromString(const QString& mode, bool* ok);
+    static const char* modeName(Mode mode);
+
+    explicit MediaSource(const QString& filename);
+    MediaSource(const QString& filename, Mode mode, guint blocksize);
+    ~MediaSource();
+
+    GstElement* element() const;
+    Mode mode() const;
+
+private:
+    Mode _mode;
+    guint _blocksize;
+    GstElement* _element = nullptr;
+
+    int _fd = -1;
+    GstBuffer* _mapping = nullptr;
+    gsize _size = 0;
+    std::atomic<guint64> _offset;
+
+    void _create(const QString& filename);
+    bool _createReadahead(const QString& filename);
+    bool _createMapped(const QString& filename);
+
+    static void _needData(GstElement* appsrc, guint length, MediaSource* source);
+    static gboolean _seekData(GstElement* appsrc, guint64 offset, MediaSource* source);
+};
+
+#endif // MEDIASOURCE_H
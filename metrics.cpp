@@ -0,0 +1,136 @@
+#include "metrics.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Family {
+    enum class Type { COUNTER, GAUGE, HISTOGRAM } type;
+    std::string help;
+    std::unique_ptr<Metrics::Counter> counter;
+    std::unique_ptr<Metrics::Gauge> gauge;
+    std::unique_ptr<Metrics::Histogram> histogram;
+};
+
+static QMutex _mutex;
+static std::map<std::string, Family> _families;
+static std::vector<std::function<void()>> _collectors;
+
+static Family& _family(const char* name, const char* help, Family::Type type) {
+    Family& family = _families[name];
+    if (family.help.empty()) {
+        family.type = type;
+        family.help = help;
+    }
+    Q_ASSERT(family.type == type);
+    return family;
+}
+
+static QByteArray _number(double value) {
+    return QByteArray::number(value, 'g', 12);
+}
+
+Metrics::Histogram::Histogram(std::initializer_list<double> bounds) :
+    _bounds(bounds),
+    _buckets(new std::atomic<quint64>[bounds.size()]) {
+    for (int i = 0; i < _bounds.size(); i++) {
+        _buckets[i] = 0;
+    }
+}
+
+void Metrics::Histogram::observe(double value) {
+    for (int i = 0; i < _bounds.size(); i++) {
+        if (value <= _bounds.at(i)) {
+            _buckets[i].fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+
+    _count.fetch_add(1, std::memory_order_relaxed);
+    double sum = _sum.load(std::memory_order_relaxed);
+    while (! _sum.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) {
+    }
+}
+
+Metrics::Counter& Metrics::counter(const char *name, const char *help) {
+    QMutexLocker lock(&_mutex);
+    Family& family = _family(name, help, Family::Type::COUNTER);
+    if (! family.counter) {
+        family.counter = std::unique_ptr<Counter>(new Counter);
+    }
+    return *family.counter;
+}
+
+Metrics::Gauge& Metrics::gauge(const char *name, const char *help) {
+    QMutexLocker lock(&_mutex);
+    Family& family = _family(name, help, Family::Type::GAUGE);
+    if (! family.gauge) {
+        family.gauge = std::unique_ptr<Gauge>(new Gauge);
+    }
+    return *family.gauge;
+}
+
+Metrics::Histogram& Metrics::histogram(const char *name, const char *help, std::initializer_list<double> bounds) {
+    QMutexLocker lock(&_mutex);
+    Family& family = _family(name, help, Family::Type::HISTOGRAM);
+    if (! family.histogram) {
+        family.histogram = std::unique_ptr<Histogram>(new Histogram(bounds));
+    }
+    return *family.histogram;
+}
+
+void Metrics::collector(const std::function<void ()> &collect) {
+    QMutexLocker lock(&_mutex);
+    _collectors.push_back(collect);
+}
+
+QByteArray Metrics::exposition() {
+    std::vector<std::function<void()>> collectors;
+    {
+        QMutexLocker lock(&_mutex);
+        collectors = _collectors;
+    }
+    for (auto& collect : collectors) {
+        collect();
+    }
+
+    QMutexLocker lock(&_mutex);
+    QByteArray out;
+    for (auto& item : _families) {
+        const QByteArray name = QByteArray::fromStdString(item.first);
+        const Family& family = item.second;
+
+        out += "# HELP " + name + ' ' + QByteArray::fromStdString(family.help) + '\n';
+        switch (family.type) {
+        case Family::Type::COUNTER:
+            out += "# TYPE " + name + " counter\n";
+            out += name + ' ' + QByteArray::number(family.counter->value()) + '\n';
+            break;
+        case Family::Type::GAUGE:
+            out += "# TYPE " + name + " gauge\n";
+            out += name + ' ' + _number(family.gauge->value()) + '\n';
+            break;
+        case Family::Type::HISTOGRAM: {
+            const Histogram& histogram = *family.histogram;
+            out += "# TYPE " + name + " histogram\n";
+
+            // buckets are stored per interval, the format wants them cumulative
+            quint64 cumulative = 0;
+            for (int i = 0; i < histogram.bounds().size(); i++) {
+                cumulative += histogram.bucket(i);
+                out += name + "_bucket{le=\"" + _number(histogram.bounds().at(i)) + "\"} " + QByteArray::number(cumulative) + '\n';
+            }
+            out += name + "_bucket{le=\"+Inf\"} " + QByteArray::number(histogram.count()) + '\n';
+            out += name + "_sum " + _number(histogram.sum()) + '\n';
+            out += name + "_count " + QByteArray::number(histogram.count()) + '\n';
+            break;
+        }
+        }
+    }
+
+    return out;
+}
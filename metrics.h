@@ -0,0 +1,61 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QVector>
+
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+
+// Process wide registry of counters, gauges and histograms, rendered in the
+// Prometheus text format by MetricsServer. Registration takes a lock and is
+// meant to happen once per call site (keep the returned reference in a
+// function local static), updates are lock free from any thread.
+class Metrics
+{
+public:
+    class Counter {
+    public:
+        void add(quint64 value = 1) { _value.fetch_add(value, std::memory_order_relaxed); }
+        quint64 value() const { return _value.load(std::memory_order_relaxed); }
+    private:
+        std::atomic<quint64> _value{0};
+    };
+
+    class Gauge {
+    public:
+        void set(double value) { _value.store(value, std::memory_order_relaxed); }
+        double value() const { return _value.load(std::memory_order_relaxed); }
+    private:
+        std::atomic<double> _value{0};
+    };
+
+    class Histogram {
+    public:
+        explicit Histogram(std::initializer_list<double> bounds);
+
+        void observe(double value);
+        const QVector<double>& bounds() const { return _bounds; }
+        quint64 bucket(int index) const { return _buckets[index].load(std::memory_order_relaxed); }
+        quint64 count() const { return _count.load(std::memory_order_relaxed); }
+        double sum() const { return _sum.load(std::memory_order_relaxed); }
+    private:
+        QVector<double> _bounds;
+        std::unique_ptr<std::atomic<quint64>[]> _buckets;
+        std::atomic<quint64> _count{0};
+        std::atomic<double> _sum{0};
+    };
+
+    static Counter& counter(const char* name, const char* help);
+    static Gauge& gauge(const char* name, const char* help);
+    static Histogram& histogram(const char* name, const char* help, std::initializer_list<double> bounds);
+
+    // called before every exposition, for gauges that are sampled rather than pushed
+    static void collector(const std::function<void()>& collect);
+
+    static QByteArray exposition();
+};
+
+#endif // METRICS_H
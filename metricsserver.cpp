@@ -0,0 +1,106 @@
+#include "metricsserver.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <QTcpSocket>
+#include <QLocalSocket>
+
+#include <QDebug>
+
+// a scraper sends a handful of headers, anything much larger isn't one
+static const int _maxRequestSize = 8192;
+
+MetricsServer::MetricsServer(QObject *parent) : QObject(parent) {
+    connect(&_tcpServer, &QTcpServer::newConnection, this, &MetricsServer::_onTcpConnection);
+    connect(&_localServer, &QLocalServer::newConnection, this, &MetricsServer::_onLocalConnection);
+}
+
+bool MetricsServer::listen(quint16 port) {
+    if (! _tcpServer.listen(QHostAddress::LocalHost, port)) {
+        qCWarning(lcMetrics) << Q_FUNC_INFO << "Failed to listen on port" << port << _tcpServer.errorString();
+        return false;
+    }
+
+    qCInfo(lcMetrics) << "Serving metrics on" << QString("http://127.0.0.1:%1/metrics").arg(_tcpServer.serverPort());
+    return true;
+}
+
+bool MetricsServer::listen(const QString &socketPath) {
+    // a socket left behind by a previous run would make listen fail
+    QLocalServer::removeServer(socketPath);
+    _localServer.setSocketOptions(QLocalServer::UserAccessOption);
+    if (! _localServer.listen(socketPath)) {
+        qCWarning(lcMetrics) << Q_FUNC_INFO << "Failed to listen on" << socketPath << _localServer.errorString();
+        return false;
+    }
+
+    qCInfo(lcMetrics) << "Serving metrics on" << _localServer.fullServerName();
+    return true;
+}
+
+void MetricsServer::_onTcpConnection() {
+    while (QTcpSocket* socket = _tcpServer.nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        _accept(socket);
+    }
+}
+
+void MetricsServer::_onLocalConnection() {
+    while (QLocalSocket* socket = _localServer.nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        _accept(socket);
+    }
+}
+
+void MetricsServer::_accept(QIODevice *connection) {
+    connect(connection, &QIODevice::readyRead, this, [this, connection] {
+        _respond(connection);
+    });
+}
+
+void MetricsServer::_respond(QIODevice *connection) {
+    QByteArray request = connection->peek(_maxRequestSize);
+    if (! request.contains("\r\n\r\n") && ! request.contains("\n\n")) {
+        if (request.size() >= _maxRequestSize) {
+            connection->close();
+        }
+        return;
+    }
+    connection->readAll();
+
+    // "GET /metrics HTTP/1.1"
+    QList<QByteArray> requestLine = request.left(request.indexOf('\n')).trimmed().split(' ');
+    QByteArray method = requestLine.value(0);
+    QByteArray path = requestLine.value(1);
+
+    QByteArray status = "200 OK";
+    QByteArray contentType = "text/plain; version=0.0.4; charset=utf-8";
+    QByteArray body;
+    if (method != "GET" && method != "HEAD") {
+        status = "405 Method Not Allowed";
+        contentType = "text/plain";
+        body = "method not allowed\n";
+    } else if (path != "/metrics" && ! path.startsWith("/metrics?")) {
+        status = "404 Not Found";
+        contentType = "text/plain";
+        body = "not found\n";
+    } else {
+        body = Metrics::exposition();
+    }
+
+    QByteArray response = "HTTP/1.0 " + status + "\r\n"
+            "Content-Type: " + contentType + "\r\n"
+            "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+            "Connection: close\r\n\r\n";
+    if (method != "HEAD") {
+        response += body;
+    }
+
+    connection->write(response);
+
+    if (QTcpSocket* socket = qobject_cast<QTcpSocket*>(connection)) {
+        socket->disconnectFromHost();
+    } else if (QLocalSocket* socket = qobject_cast<QLocalSocket*>(connection)) {
+        socket->disconnectFromServer();
+    }
+}
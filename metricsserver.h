@@ -0,0 +1,33 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QLocalServer>
+
+class QIODevice;
+
+// Answers "GET /metrics" with Metrics::exposition(), on a loopback TCP port
+// and/or a Unix domain socket. Only the bits of HTTP/1.0 a Prometheus
+// scraper needs, one request per connection.
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsServer(QObject *parent = 0);
+
+    bool listen(quint16 port);
+    bool listen(const QString& socketPath);
+
+private:
+    QTcpServer _tcpServer;
+    QLocalServer _localServer;
+
+    void _accept(QIODevice* connection);
+    void _respond(QIODevice* connection);
+private slots:
+    void _onTcpConnection();
+    void _onLocalConnection();
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,90 @@
+#include "playbacksurface.h"
+#include "logger.h"
+#include "windowsurface.h"
+
+#include <QGuiApplication>
+
+static PlaybackSurface::Backend _backend = PlaybackSurface::Backend::WIDGET;
+
+void PlaybackSurface::configure(PlaybackSurface::Backend backend) {
+    _backend = backend;
+}
+
+PlaybackSurface::Backend PlaybackSurface::backendFromString(const QString &backend, bool *ok) {
+    for (auto candidate : {Backend::WIDGET, Backend::THREAD, Backend::DIRECT}) {
+        if (backend.compare(backendName(candidate), Qt::CaseInsensitive) == 0) {
+            *ok = true;
+            return candidate;
+        }
+    }
+
+    *ok = false;
+    return Backend::WIDGET;
+}
+
+const char *PlaybackSurface::backendName(PlaybackSurface::Backend backend) {
+    switch (backend) {
+    case Backend::WIDGET:
+        return "widget";
+    case Backend::THREAD:
+        return "thread";
+    case Backend::DIRECT:
+        return "direct";
+    }
+
+    return "widget";
+}
+
+PlaybackSurface *PlaybackSurface::create() {
+    if (_backend != Backend::WIDGET) {
+        bool threaded = _backend == Backend::THREAD;
+        if (WindowSurface::isSupported(threaded)) {
+            return new WindowSurface(threaded);
+        }
+        qCWarning(lcPlayer) << Q_FUNC_INFO << "The" << backendName(_backend) << "backend isn't supported by the" << QGuiApplication::platformName() << "platform, using widgets";
+    }
+
+    return new WidgetSurface;
+}
+
+PlaybackSurface::PlaybackSurface(QWidget *parent) : QWidget(parent) {
+}
+
+WidgetSurface::WidgetSurface(QWidget *parent) : PlaybackSurface(parent) {
+    _layout.addWidget(&_videoPlayer);
+    _layout.addWidget(&_imagePlayer);
+    setLayout(&_layout);
+
+    connect(&_videoPlayer, &VideoPlayer::finished, this, &PlaybackSurface::finished);
+    connect(&_imagePlayer, &ImagePlayer::timeout, this, &PlaybackSurface::finished);
+    connect(&_videoPlayer, &VideoPlayer::framePresented, this, &PlaybackSurface::framePresented);
+    connect(&_imagePlayer, &ImagePlayer::framePresented, this, &PlaybackSurface::framePresented);
+    connect(&_videoPlayer, &VideoPlayer::duration, this, &PlaybackSurface::duration);
+}
+
+void WidgetSurface::initPipeline() {
+    _videoPlayer.initPipeline();
+}
+
+void WidgetSurface::resetPipeline() {
+    _videoPlayer.resetPipeline();
+}
+
+void WidgetSurface::openVideo(const QString &filename, quint64 startTime) {
+    _videoPlayer.open(filename, startTime);
+}
+
+void WidgetSurface::showVideo(const QImage &poster) {
+    _videoPlayer.poster(poster);
+    _layout.setCurrentWidget(&_videoPlayer);
+}
+
+void WidgetSurface::showImage(const QString &filename, int duration, const QImage &image) {
+    _layout.setCurrentWidget(&_imagePlayer);
+    _imagePlayer.open(filename, duration, image);
+}
+
+void WidgetSurface::stop() {
+    _videoPlayer.stop();
+    _imagePlayer.stop();
+}
@@ -0,0 +1,70 @@
+#ifndef PLAYBACKSURFACE_H
+#define PLAYBACKSURFACE_H
+
+#include "imageplayer.h"
+#include "videoplayer.h"
+
+#include <QStackedLayout>
+#include <QWidget>
+
+// What DisupureiWindow plays entries on. The backends differ in which
+// thread does the GL work:
+//
+//  WIDGET  VideoPlayer and ImagePlayer widgets, drawn on the GUI thread
+//          into FBOs that Qt then composites into the top-level window
+//  THREAD  a RenderWindow with a context owned by a render thread, frames
+//          are drawn and swapped as they are decoded, whatever the GUI
+//          thread is busy with
+//  DIRECT  a RenderWindow drawn on the GUI thread straight to its default
+//          framebuffer, without the FBO and the composition blit
+class PlaybackSurface : public QWidget
+{
+    Q_OBJECT
+public:
+    enum class Backend {
+        WIDGET, THREAD, DIRECT
+    };
+
+    static void configure(Backend backend);
+    static Backend backendFromString(const QString& backend, bool* ok);
+    static const char* backendName(Backend backend);
+    // falls back to WIDGET where the configured backend can't run
+    static PlaybackSurface* create();
+
+    explicit PlaybackSurface(QWidget* parent = 0);
+
+    virtual void initPipeline() = 0;
+    virtual void resetPipeline() = 0;
+    // prerolls a video, it replaces the image on screen with showVideo()
+    virtual void openVideo(const QString& filename, quint64 startTime) = 0;
+    // a poster, when not null, stands in until the first frame is decoded
+    virtual void showVideo(const QImage& poster) = 0;
+    virtual void showImage(const QString& filename, int duration, const QImage& image) = 0;
+    virtual void stop() = 0;
+
+signals:
+    void finished();
+    void framePresented();
+    void duration(qint64 millis);
+};
+
+class WidgetSurface : public PlaybackSurface
+{
+    Q_OBJECT
+public:
+    explicit WidgetSurface(QWidget* parent = 0);
+
+    void initPipeline() override;
+    void resetPipeline() override;
+    void openVideo(const QString& filename, quint64 startTime) override;
+    void showVideo(const QImage& poster) override;
+    void showImage(const QString& filename, int duration, const QImage& image) override;
+    void stop() override;
+
+private:
+    QStackedLayout _layout;
+    VideoPlayer _videoPlayer;
+    ImagePlayer _imagePlayer;
+};
+
+#endif // PLAYBACKSURFACE_H
@@ -1,10 +1,14 @@
 #include "playlist.h"
 
 #include <QtNetwork/QNetworkReply>
+#include <QCryptographicHash>
 #include <QStandardPaths>
+#include <QFileInfo>
+#include <QHash>
 
 #include <QJsonArray>
 #include <QJsonParseError>
+#include <QUrlQuery>
 
 #include <QMetaEnum>
 
@@ -13,6 +17,11 @@
 
 #include <QDebug>
 
+#include "logger.h"
+#include "metrics.h"
+#include "startupprofile.h"
+#include "trace.h"
+
 template <typename T>
 static T toCaseInsensitiveEnum(const QString& key, bool* ok) {
     auto enumerator = QMetaEnum::fromType<T>();
@@ -28,26 +37,25 @@ static T toCaseInsensitiveEnum(const QString& key, bool* ok) {
     return static_cast<T>(-1);
 }
 
-Playlist::Playlist(QObject *parent) : QObject(parent) {
-    _cachePath.setPath(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
-    if (! _cachePath.exists()) {
-        _cachePath.mkpath(".");
-    }
-
-    _entryPath.setPath(_cachePath.filePath("entries"));
-    if (! _entryPath.exists()) {
-        _entryPath.mkpath(".");
-    }
+Playlist::Playlist(QObject *parent) : QObject(parent), _cache(std::make_shared<MediaCache>()) {
+    _cache->attach(this);
+    connect(_cache.get(), &MediaCache::fetched, this, &Playlist::onEntryFetched);
+    cachePath(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
 
     connect(&_metadataRefreshTimer, &QTimer::timeout, this, &Playlist::refreshMetadata);
-    _metadataRefreshTimer.start(10000);
+    _metadataRefreshTimer.start(_refreshMillis);
+    connect(&_push, &PushChannel::connected, this, &Playlist::onPushConnected);
+    connect(&_push, &PushChannel::changed, this, &Playlist::refreshMetadata);
 }
 
 Playlist::~Playlist() {
     _metadataRefreshTimer.stop();
+    _cache->detach(this);
 }
 
 const Entry &Playlist::next() {
+    TRACE_SPAN("Playlist::next");
+
     ++_playbackIterator;
     if (_playbackIterator == _entries.end()) {
         _playbackIterator = _entries.begin();
@@ -56,6 +64,24 @@ const Entry &Playlist::next() {
     return *_playbackIterator;
 }
 
+QVector<Entry> Playlist::upcoming(int count) const {
+    QVector<Entry> entries;
+    if (_entries.isEmpty()) {
+        return entries;
+    }
+
+    int index = _playbackIterator - _entries.constBegin();
+    for (int i = 1; i <= qMin(count, _entries.size()); i++) {
+        entries.append(_entries.at((index + i) % _entries.size()));
+    }
+
+    return entries;
+}
+
+bool Playlist::isEmpty() const {
+    return _entries.isEmpty();
+}
+
 void Playlist::macAddress(const QString &address) {
     _mac = address;
 }
@@ -64,65 +90,303 @@ void Playlist::url(const QString &url) {
     _url = url;
 }
 
-void Playlist::cleanupStaleEntries() {
-    QSet<QString> entries = _entryPath.entryList({}, QDir::Files).toSet();
+void Playlist::cachePath(const QString &path) {
+    _cachePath.setPath(path);
+    if (! _cachePath.exists()) {
+        _cachePath.mkpath(".");
+    }
+
+    // a shared cache keeps the directory it was given
+    if (! _sharedCache) {
+        _cache->path(_cachePath.filePath("entries"));
+    }
+}
+
+void Playlist::mediaCache(const std::shared_ptr<MediaCache> &cache) {
+    disconnect(_cache.get(), &MediaCache::fetched, this, &Playlist::onEntryFetched);
+    _cache->detach(this);
+
+    _cache = cache;
+    _sharedCache = true;
+    _cache->attach(this);
+    connect(_cache.get(), &MediaCache::fetched, this, &Playlist::onEntryFetched);
+}
+
+void Playlist::screenSize(const QSize &size) {
+    _screenSize = size;
+}
+
+void Playlist::refreshInterval(int millis) {
+    _refreshMillis = millis;
+    if (! _push.isConnected()) {
+        _metadataRefreshTimer.start(millis);
+    }
+}
+
+void Playlist::push(int fallbackMillis) {
+    _fallbackMillis = qMax(1000, fallbackMillis);
+    _push.open(QUrl(QString("%1/api/events/%2").arg(_url).arg(_mac)));
+}
+
+void Playlist::preferImageStart(bool prefer) {
+    _preferImageStart = prefer;
+}
+
+void Playlist::decodeLimits(const QVector<DecodeLimit> &limits) {
+    QString hint = decodeHint();
+    _decodeLimits = limits;
+
+    // videos fetched under the old hint may not play well, read the sequence again
+    if (decodeHint() != hint && _published != -1) {
+        _published = -1;
+        parseMetadata();
+    }
+}
+
+// the server may use it to pick or transcode a rendition, e.g. h264:1080p60,vp9:720p30
+QString Playlist::decodeHint() const {
+    QStringList hints;
+    for (auto& limit : _decodeLimits) {
+        hints.append(QString("%1:%2p%3").arg(limit.codec).arg(limit.height).arg(limit.fps));
+    }
+    return hints.join(',');
+}
+
+void Playlist::readCachedMetadataAsync() {
+    QString path = _cachePath.filePath("metadata");
+    if (! QFile(path).exists()) {
+        return;
+    }
+
+    _cachedMetadata = std::async(std::launch::async, [path] {
+        QFile input(path);
+        input.open(QIODevice::ReadOnly);
+        return openJsonFile(input);
+    });
+}
 
+// The claim covers the sequence being fetched as well as the one playing,
+// another playlist's cleanup must not remove what this one has just
+// downloaded and not yet rotated in.
+void Playlist::cleanupStaleEntries(const QString &keepKey) {
+    QSet<QString> keys;
     for (auto& entry : _entries) {
-        entries.remove(entry.fileId);
+        keys.insert(QFileInfo(entry.filePath).fileName());
+    }
+    for (auto& entry : _refreshEntries) {
+        keys.insert(QFileInfo(entry.filePath).fileName());
+    }
+    if (! _fetchingKey.isEmpty()) {
+        keys.insert(_fetchingKey);
+    }
+    if (! keepKey.isEmpty()) {
+        keys.insert(keepKey);
     }
 
-    for (auto& staleEntry : entries) {
-        QFile fileEntry(_entryPath.filePath(staleEntry));
-        fileEntry.remove();
+    _cache->claim(this, keys);
+}
+
+void Playlist::startRotation() {
+    _entries = _refreshEntries;
+    _playbackIterator = _entries.end();
+    --_playbackIterator;
+
+    if (_preferImageStart) {
+        // start on an image, those are on screen without waiting for the video pipeline
+        _preferImageStart = false;
+        for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+            if (it->type == Playlist::Type::IMAGE) {
+                _playbackIterator = (it == _entries.begin()) ? _entries.end() - 1 : it - 1;
+                break;
+            }
+        }
+    }
+
+    emit playlistAvailable();
+
+    cleanupStaleEntries();
+}
+
+// The sequence has no entries left, or none could be downloaded. Nothing
+// plays until a sequence has entries again, and the files are released.
+void Playlist::stopRotation() {
+    bool playing = ! _entries.isEmpty();
+    _entries.clear();
+    _playbackIterator = _entries.end();
+    if (playing) {
+        emit playlistEmptied();
+    }
+
+    cleanupStaleEntries();
+}
+
+// Swaps in the new sequence under the running rotation. next() carries on
+// after the playing entry in the new order, or when that is gone, with the
+// first entry that followed it before and still is in the sequence. The
+// playing entry's file is kept until the next change.
+void Playlist::patchRotation() {
+    static auto& patches = Metrics::counter("disupurei_sequence_patches_total", "Sequence changes applied without restarting the rotation");
+
+    QHash<QString, int> positions;
+    for (int i = 0; i < _refreshEntries.size(); i++) {
+        if (! _refreshEntries.at(i).id.isEmpty() && ! positions.contains(_refreshEntries.at(i).id)) {
+            positions.insert(_refreshEntries.at(i).id, i);
+        }
+    }
 
-        qInfo() << "Removed stale entry" << fileEntry.fileName();
+    int playing = _playbackIterator - _entries.begin();
+    QString playingKey = QFileInfo(_playbackIterator->filePath).fileName();
+    int next = 0;
+    for (int i = 0; i < _entries.size(); i++) {
+        auto position = positions.constFind(_entries.at((playing + i) % _entries.size()).id);
+        if (position != positions.constEnd()) {
+            next = i == 0 ? position.value() + 1 : position.value();
+            break;
+        }
     }
+
+    _entries = _refreshEntries;
+    _playbackIterator = _entries.begin() + (next + _entries.size() - 1) % _entries.size();
+    patches.add();
+    emit playlistUpdated();
+
+    cleanupStaleEntries(playingKey);
 }
 
 void Playlist::downloadEntries() {
-    if (_refreshIterator == _refreshEntries.end()) {
-        _entries = _refreshEntries;
-        _playbackIterator = _entries.end();
-        --_playbackIterator;
-        emit playlistAvailable();
+    // entries carried over from the previous sequence only have to still be on disk
+    while (_refreshIterator != _refreshEntries.end() && _refreshIterator->loaded) {
+        if (! _cache->contains(QFileInfo(_refreshIterator->filePath).fileName())) {
+            _refreshIterator->loaded = false;
+            break;
+        }
+        ++_refreshIterator;
+    }
 
-        cleanupStaleEntries();
+    if (_refreshIterator == _refreshEntries.end()) {
+        if (_refreshEntries.isEmpty()) {
+            stopRotation();
+        } else if (_entries.isEmpty()) {
+            startRotation();
+        } else {
+            patchRotation();
+        }
         return;
     }
 
-    QFile entryFile(_entryPath.filePath(_refreshIterator->fileId));
-    if (! entryFile.exists()) {
-        qDebug() << "Downloading" << _refreshIterator->url;
-        auto reply = _nam.get(QNetworkRequest(_refreshIterator->url));
-        connect(reply, &QNetworkReply::finished, this, &Playlist::onFetchEntryFinished);
+    static auto& cacheHits = Metrics::counter("disupurei_cache_hits_total", "Sequence entries already in the local cache");
+    static auto& cacheMisses = Metrics::counter("disupurei_cache_misses_total", "Sequence entries that had to be downloaded");
+
+    QString key = QFileInfo(_refreshIterator->filePath).fileName();
+    if (! _cache->contains(key)) {
+        cacheMisses.add();
+        _fetchingKey = key;
+        _cache->fetch(key, _refreshIterator->url);
     } else {
+        cacheHits.add();
+        _refreshIterator->loaded = true;
+        if (_refreshIterator->type == Playlist::Type::VIDEO) {
+            emit videoCached(_refreshIterator->filePath, screen());
+        }
         ++_refreshIterator;
         downloadEntries();
     }
 }
 
-void Playlist::onFetchEntryFinished() {
-    auto reply = qobject_cast<QNetworkReply*>(sender());
-    reply->deleteLater();
+void Playlist::onEntryFetched(const QString &key, bool ok) {
+    // the cache reports every download, including those of other playlists
+    if (_fetchingKey.isEmpty() || key != _fetchingKey) {
+        return;
+    }
+    _fetchingKey.clear();
 
-    if (reply->error() != QNetworkReply::NoError) {
-        qWarning() << "Failed to download item at url" << _refreshIterator->url << ", removing entry";
-		_refreshEntries.erase(_refreshIterator);
+    if (! ok) {
+        qCWarning(lcPlaylist) << "Removing entry" << _refreshIterator->fileId;
+        _refreshIterator = _refreshEntries.erase(_refreshIterator);
     } else {
-        QFile entryFile(_entryPath.filePath(_refreshIterator->fileId));
-        entryFile.open(QIODevice::WriteOnly);
-        entryFile.write(reply->readAll());
         _refreshIterator->loaded = true;
-
-		++_refreshIterator;
+        if (_refreshIterator->type == Playlist::Type::VIDEO) {
+            emit videoCached(_refreshIterator->filePath, screen());
+        }
+        ++_refreshIterator;
     }
 
     downloadEntries();
 }
 
+QSize Playlist::screen() const {
+    return _screenSize.isValid() ? _screenSize : QApplication::desktop()->screenGeometry().size();
+}
+
+bool Playlist::decodable(const QJsonObject &rendition) const {
+    for (auto& limit : _decodeLimits) {
+        if (limit.codec.compare(rendition["codec"].toString(), Qt::CaseInsensitive) == 0) {
+            return rendition["height"].toInt() <= limit.height && rendition["fps"].toInt(30) <= limit.fps;
+        }
+    }
+    return false;
+}
+
+// Of the renditions ({"fileId", "codec", "height", "fps"}) the device
+// decodes in real time, the smallest that still fills the screen, else the
+// tallest. Without renditions or decode limits the server picks, fileId.
+QString Playlist::selectRendition(const QJsonObject &entryObj, const QSize &screen) const {
+    QJsonObject best;
+    for (auto value : entryObj["renditions"].toArray()) {
+        QJsonObject rendition = value.toObject();
+        if (! decodable(rendition)) {
+            continue;
+        }
+        if (best.isEmpty()) {
+            best = rendition;
+            continue;
+        }
+
+        int height = rendition["height"].toInt();
+        int bestHeight = best["height"].toInt();
+        bool fills = height >= screen.height();
+        bool bestFills = bestHeight >= screen.height();
+        bool better;
+        if (height == bestHeight) {
+            better = rendition["fps"].toInt(30) > best["fps"].toInt(30);
+        } else if (fills != bestFills) {
+            better = fills;
+        } else {
+            better = fills ? height < bestHeight : height > bestHeight;
+        }
+        if (better) {
+            best = rendition;
+        }
+    }
+
+    if (best.isEmpty()) {
+        return entryObj["fileId"].toString();
+    }
+    qCDebug(lcPlaylist) << "Playing rendition" << best;
+    return best["fileId"].toString();
+}
+
 void Playlist::parseMetadataEntries(QJsonArray entries) {
     _refreshEntries.clear();
-    QRect desktopResolution = QApplication::desktop()->screenGeometry();
+    _fetchingKey.clear();
+    QSize screen = this->screen();
+
+    // entries with the same id and file as before are carried over as they are
+    static auto& reused = Metrics::counter("disupurei_sequence_entries_reused_total", "Entries carried over unchanged into a new sequence");
+    QHash<QString, Entry> previous;
+    for (auto& entry : _entries) {
+        if (! entry.id.isEmpty()) {
+            previous.insert(entry.id, entry);
+        }
+    }
+
+    // the same rendition may come back transcoded differently for another
+    // hint, so the hint is part of the file name
+    QString hint = decodeHint();
+    QString hintKey;
+    if (! hint.isEmpty()) {
+        hintKey = QString::fromLatin1(QCryptographicHash::hash(hint.toUtf8(), QCryptographicHash::Md5).toHex().left(8));
+    }
 
     for (QJsonValueRef entry_value : entries) {
         QJsonObject entryObj = entry_value.toObject();
@@ -130,29 +394,48 @@ void Playlist::parseMetadataEntries(QJsonArray entries) {
         bool typeOk;
         Playlist::Type type = toCaseInsensitiveEnum<Playlist::Type>(entryObj["type"].toString(), &typeOk);
         if (! typeOk) {
-            qWarning() << "Garbage in sequence, skipping entry";
-            qWarning() << "\t" << entryObj;
+            qCWarning(lcPlaylist) << "Garbage in sequence, skipping entry";
+            qCWarning(lcPlaylist) << "\t" << entryObj;
             continue;
         }
 
         Entry entry;
+        entry.id = entryObj["id"].toString();
         entry.fileId = entryObj["fileId"].toString();
-        entry.filePath = _entryPath.filePath(entry.fileId);
         entry.type = type;
         switch (type) {
             case Playlist::Type::IMAGE:
             // {\"id\":\"ad934f06-973a-4937-b402-0a057871340a\",\"type\":\"image\",\"fileId\":\"7635d251-e3a1-4818-b59c-86b089514256\",\"durationMillis\":15000}
             entry.durationMillis = entryObj["durationMillis"].toInt();
-            entry.url.setUrl(QString("%1/api/getImage/%2/%3/%4").arg(_url).arg(entry.fileId).arg(desktopResolution.width()).arg(desktopResolution.height()));
+            entry.url.setUrl(QString("%1/api/getImage/%2/%3/%4").arg(_url).arg(entry.fileId).arg(screen.width()).arg(screen.height()));
+            // images are scaled by the server, outputs of different sizes need their own copy
+            entry.filePath = _cache->filePath(QString("%1-%2x%3").arg(entry.fileId).arg(screen.width()).arg(screen.height()));
             break;
             case Playlist::Type::VIDEO:
             // {\"id\":\"af46cf69-b8d2-4f5d-bf31-c57736e4f92b\",\"type\":\"video\",\"fileId\":\"e8043297-5ac3-45c6-a92b-ad5e19468c2f\",\"transcodingComplete\":true}
+            entry.fileId = selectRendition(entryObj, screen);
             entry.url.setUrl(QString("%1/api/getVideo/%2/%3").arg(_url).arg(_mac).arg(entry.fileId));
+            if (! hint.isEmpty()) {
+                QUrlQuery query;
+                query.addQueryItem("decode", hint);
+                entry.url.setQuery(query);
+                entry.filePath = _cache->filePath(QString("%1-%2").arg(entry.fileId).arg(hintKey));
+            } else {
+                entry.filePath = _cache->filePath(entry.fileId);
+            }
             break;
         }
+
+        auto known = previous.constFind(entry.id);
+        if (known != previous.constEnd() && known->type == entry.type && known->filePath == entry.filePath
+                && known->durationMillis == entry.durationMillis) {
+            entry.loaded = true;
+            reused.add();
+        }
         _refreshEntries.append(entry);
     }
 
+    cleanupStaleEntries();
     _refreshIterator = _refreshEntries.begin();
     downloadEntries();
 }
@@ -163,10 +446,14 @@ void Playlist::parseMetadata() {
 
     QJsonObject root = openJsonFile(input);
     if (root.isEmpty()) {
-        qWarning() << Q_FUNC_INFO << "Failed to parse metadata file, located at" << input.fileName();
+        qCWarning(lcPlaylist) << Q_FUNC_INFO << "Failed to parse metadata file, located at" << input.fileName();
         return;
     }
 
+    applyMetadata(root);
+}
+
+void Playlist::applyMetadata(const QJsonObject &root) {
     QJsonObject data = root["data"].toObject();
     QJsonObject sequence = data["sequence"].toObject();
     QString sequenceId = sequence["id"].toString();
@@ -181,22 +468,38 @@ void Playlist::parseMetadata() {
 
 void Playlist::refreshMetadata() {
     QNetworkRequest req(QUrl(QString("%1/api/getSequence/%2.json").arg(_url).arg(_mac)));
+    _refreshClock.start();
+    Trace::asyncBegin("metadata refresh", (quintptr) this);
     auto reply = _nam.get(req);
     connect(reply, &QNetworkReply::finished, this, &Playlist::onRefreshFinished);
 }
 
 void Playlist::checkForCachedMetadata() {
-    if (QFile(_cachePath.filePath("metadata")).exists()) {
+    if (_cachedMetadata.valid()) {
+        QJsonObject root = _cachedMetadata.get();
+        if (! root.isEmpty()) {
+            applyMetadata(root);
+        }
+    } else if (QFile(_cachePath.filePath("metadata")).exists()) {
         parseMetadata();
     }
+
+    StartupProfile::mark("metadata");
 }
 
 void Playlist::onRefreshFinished() {
+    static auto& refreshFailures = Metrics::counter("disupurei_metadata_refresh_failures_total", "Sequence metadata requests that failed");
+    static auto& refreshLatency = Metrics::histogram("disupurei_metadata_refresh_seconds", "Sequence metadata request latency",
+                                                     {0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10});
+
     auto reply = qobject_cast<QNetworkReply*>(sender());
     reply->deleteLater();
+    refreshLatency.observe(_refreshClock.elapsed() / 1000.0);
+    Trace::asyncEnd("metadata refresh", (quintptr) this);
 
     if (reply->error() != QNetworkReply::NoError) {
-        qWarning() << Q_FUNC_INFO << "Failed to refresh metadata";
+        refreshFailures.add();
+        qCWarning(lcPlaylist) << Q_FUNC_INFO << "Failed to refresh metadata";
         return;
     }
 
@@ -208,14 +511,24 @@ void Playlist::onRefreshFinished() {
     parseMetadata();
 }
 
+void Playlist::onPushConnected(bool connected) {
+    qCDebug(lcPlaylist) << Q_FUNC_INFO << connected;
+    _metadataRefreshTimer.start(connected ? _fallbackMillis : _refreshMillis);
+
+    // whatever changed while the stream was down went unannounced
+    if (connected) {
+        refreshMetadata();
+    }
+}
+
 QJsonObject Playlist::openJsonFile(QFile& sourceFile) {
     QJsonParseError parseError;
     QString rawJson = QString::fromUtf8(sourceFile.readAll());
 
     QJsonDocument json = QJsonDocument::fromJson(rawJson.toUtf8(), &parseError);
     if (parseError.error != QJsonParseError::NoError) {
-        qWarning() << "Failed to parse JSON";
-        qWarning() << "\t" << parseError.errorString();
+        qCWarning(lcPlaylist) << "Failed to parse JSON";
+        qCWarning(lcPlaylist) << "\t" << parseError.errorString();
         return QJsonObject();
     }
 
@@ -4,8 +4,12 @@
 #include <QObject>
 
 #include <functional>
+#include <future>
+#include <memory>
 
 #include <QDir>
+#include <QElapsedTimer>
+#include <QSize>
 #include <QUrl>
 #include <QTimer>
 #include <QVector>
@@ -13,7 +17,18 @@
 
 #include <QJsonObject>
 
+#include "mediacache.h"
+#include "pushchannel.h"
+
 struct Entry;
+
+// A codec the device decodes in real time, up to this height and frame rate
+struct DecodeLimit {
+    QString codec;
+    int height;
+    int fps;
+};
+
 class Playlist : public QObject
 {
     Q_OBJECT
@@ -27,12 +42,33 @@ public:
     ~Playlist();
 
     const Entry& next();
+    QVector<Entry> upcoming(int count) const;
+    bool isEmpty() const;
 
     void macAddress(const QString& address);
     void url(const QString& url);
+    void cachePath(const QString& path);
+    void mediaCache(const std::shared_ptr<MediaCache>& cache);
+    void screenSize(const QSize& size);
+    void refreshInterval(int millis);
+    // listens for sequence changes at <url>/api/events/<mac>, polling only
+    // every fallbackMillis while the stream is up
+    void push(int fallbackMillis);
+    void preferImageStart(bool prefer);
+    // steers video downloads to renditions the device keeps up with
+    void decodeLimits(const QVector<DecodeLimit>& limits);
+
+    void readCachedMetadataAsync();
 
 signals:
+    // the rotation (re)starts from the top
     void playlistAvailable();
+    // the sequence changed under a running rotation, the playing entry goes on
+    void playlistUpdated();
+    // the sequence has no entries, the rotation stopped
+    void playlistEmptied();
+    // a video entry is on disk, whether just downloaded or already cached
+    void videoCached(const QString& filePath, const QSize& screen);
 
 public slots:
     void refreshMetadata();
@@ -42,8 +78,14 @@ private:
     QString _sequenceId;
     qint64 _published = -1;
     QTimer _metadataRefreshTimer;
+    int _refreshMillis = 10000;
+    int _fallbackMillis = 0;
+    PushChannel _push;
     QDir _cachePath;
-    QDir _entryPath;
+    std::shared_ptr<MediaCache> _cache;
+    bool _sharedCache = false;
+    QSize _screenSize;
+    QString _fetchingKey;
     QNetworkAccessManager _nam;
     QVector<Entry> _entries;
     QVector<Entry> _refreshEntries;
@@ -51,24 +93,39 @@ private:
     QVector<Entry>::Iterator _playbackIterator;
     QString _mac;
     QString _url;
+    bool _preferImageStart = false;
+    QVector<DecodeLimit> _decodeLimits;
+    std::future<QJsonObject> _cachedMetadata;
+    QElapsedTimer _refreshClock;
 
-    void cleanupStaleEntries();
+    QSize screen() const;
+    QString decodeHint() const;
+    bool decodable(const QJsonObject& rendition) const;
+    QString selectRendition(const QJsonObject& entryObj, const QSize& screen) const;
+    void cleanupStaleEntries(const QString& keepKey = QString());
     void downloadEntries();
+    void startRotation();
+    void stopRotation();
+    void patchRotation();
 
     void parseMetadata();
+    void applyMetadata(const QJsonObject& root);
     void parseMetadataEntries(QJsonArray entries);
-    QJsonObject openJsonFile(QFile& sourceFile);
+    static QJsonObject openJsonFile(QFile& sourceFile);
 private slots:
     void onRefreshFinished();
-    void onFetchEntryFinished();
+    void onPushConnected(bool connected);
+    void onEntryFetched(const QString& key, bool ok);
 };
 
 struct Entry {
+    QString id;
     QString fileId;
     QString filePath;
     Playlist::Type type;
-    int durationMillis;
+    int durationMillis = 0;
     QUrl url;
+    // on disk, nothing to fetch
     bool loaded = false;
 };
 
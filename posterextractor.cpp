@@ -0,0 +1,151 @@
+#include "posterextractor.h"
+#include "gstpipeline.h"
+#include "logger.h"
+#include "mediacache.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <QFile>
+#include <QImage>
+#include <QMutex>
+#include <QSaveFile>
+#include <QSet>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+// outputs sharing a media cache each ask for the same poster, and a video
+// that yields none is not tried again on every refresh
+static QMutex _inFlightMutex;
+static QSet<QString> _inFlight;
+static QSet<QString> _failed;
+
+PosterExtractor::PosterExtractor() {
+    moveToThread(&_thread);
+    setObjectName("PosterExtractor");
+    _thread.setObjectName("PosterExtractor");
+
+    connect(this, &PosterExtractor::extractRequested, this, &PosterExtractor::_extract);
+    _thread.start(QThread::LowPriority);
+}
+
+PosterExtractor::~PosterExtractor() {
+    _thread.quit();
+    _thread.wait();
+}
+
+void PosterExtractor::extract(const QString &videoPath, const QSize &size) {
+    if (QFile::exists(MediaCache::posterPath(videoPath))) {
+        return;
+    }
+
+    emit extractRequested(videoPath, size);
+}
+
+void PosterExtractor::_extract(const QString &videoPath, const QSize &size) {
+    static auto& extracted = Metrics::counter("disupurei_posters_extracted_total", "Poster frames extracted from downloaded videos");
+    static auto& failures = Metrics::counter("disupurei_poster_failures_total", "Videos no poster frame could be extracted from");
+
+    QString posterPath = MediaCache::posterPath(videoPath);
+    {
+        QMutexLocker lock(&_inFlightMutex);
+        if (QFile::exists(posterPath) || _inFlight.contains(posterPath) || _failed.contains(posterPath)) {
+            return;
+        }
+        _inFlight.insert(posterPath);
+    }
+
+    TRACE_SPAN("PosterExtractor::extract");
+    QImage poster = _firstFrame(videoPath, size);
+
+    QSaveFile output(posterPath);
+    bool ok = ! poster.isNull() && output.open(QIODevice::WriteOnly) && poster.save(&output, "JPEG", 90) && output.commit();
+    if (ok) {
+        extracted.add();
+        qCDebug(lcPrefetch) << "Extracted poster" << posterPath << poster.size();
+    } else {
+        failures.add();
+        qCWarning(lcPrefetch) << Q_FUNC_INFO << "No poster frame for" << videoPath;
+    }
+
+    QMutexLocker lock(&_inFlightMutex);
+    _inFlight.remove(posterPath);
+    if (! ok) {
+        _failed.insert(posterPath);
+    }
+}
+
+// prerolls a throwaway pipeline and converts the preroll buffer to RGB
+// at the largest size that fits, never above the video's own size
+QImage PosterExtractor::_firstFrame(const QString &videoPath, const QSize &size) {
+    GstreamerPipeline::waitForGstreamer();
+
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch("filesrc name=src ! decodebin name=decodebin ! videoconvert ! video/x-raw ! fakesink name=sink enable-last-sample=true", &error);
+    if (pipeline == nullptr) {
+        qCWarning(lcPrefetch) << Q_FUNC_INFO << "Failed to create pipeline" << (error != nullptr ? error->message : "");
+        g_clear_error(&error);
+        return QImage();
+    }
+    g_clear_error(&error);
+
+    GstElement* decodebin = gst_bin_get_by_name(GST_BIN(pipeline), "decodebin");
+    GstreamerPipeline::videoOnly(decodebin);
+    gst_object_unref(decodebin);
+
+    GstElement* src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    g_object_set(src, "location", QFile::encodeName(videoPath).constData(), nullptr);
+    gst_object_unref(src);
+
+    GstSample* sample = nullptr;
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    if (gst_element_get_state(pipeline, nullptr, nullptr, 10 * GST_SECOND) == GST_STATE_CHANGE_SUCCESS) {
+        GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+        g_object_get(sink, "last-sample", &sample, nullptr);
+        gst_object_unref(sink);
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    GstVideoInfo info;
+    if (sample == nullptr || ! gst_video_info_from_caps(&info, gst_sample_get_caps(sample))) {
+        if (sample != nullptr) {
+            gst_sample_unref(sample);
+        }
+        return QImage();
+    }
+
+    QSize source(GST_VIDEO_INFO_WIDTH(&info) * GST_VIDEO_INFO_PAR_N(&info) / qMax(1, GST_VIDEO_INFO_PAR_D(&info)), GST_VIDEO_INFO_HEIGHT(&info));
+    QSize target = source;
+    if (size.isValid() && (source.width() > size.width() || source.height() > size.height())) {
+        target = source.scaled(size, Qt::KeepAspectRatio);
+    }
+
+    GstCaps* rgb = gst_caps_new_simple("video/x-raw",
+                                       "format", G_TYPE_STRING, "RGB",
+                                       "width", G_TYPE_INT, qMax(1, target.width()),
+                                       "height", G_TYPE_INT, qMax(1, target.height()),
+                                       "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1,
+                                       nullptr);
+    GstSample* converted = gst_video_convert_sample(sample, rgb, 5 * GST_SECOND, &error);
+    gst_caps_unref(rgb);
+    gst_sample_unref(sample);
+    if (converted == nullptr) {
+        qCWarning(lcPrefetch) << Q_FUNC_INFO << "Failed to convert" << videoPath << (error != nullptr ? error->message : "");
+        g_clear_error(&error);
+        return QImage();
+    }
+
+    QImage image;
+    GstVideoInfo rgbInfo;
+    GstMapInfo map;
+    GstBuffer* buffer = gst_sample_get_buffer(converted);
+    if (gst_video_info_from_caps(&rgbInfo, gst_sample_get_caps(converted)) && gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        image = QImage(map.data, GST_VIDEO_INFO_WIDTH(&rgbInfo), GST_VIDEO_INFO_HEIGHT(&rgbInfo),
+                       GST_VIDEO_INFO_PLANE_STRIDE(&rgbInfo, 0), QImage::Format_RGB888).copy();
+        gst_buffer_unmap(buffer, &map);
+    }
+    gst_sample_unref(converted);
+
+    return image;
+}
@@ -0,0 +1,33 @@
+#ifndef POSTEREXTRACTOR_H
+#define POSTEREXTRACTOR_H
+
+#include <QImage>
+#include <QObject>
+#include <QSize>
+#include <QThread>
+
+// Saves the first frame of each downloaded video as a JPEG poster next to
+// it (MediaCache::posterPath), scaled down to fit the screen. The player
+// shows the poster the moment a video starts, while the pipeline is still
+// prerolling. Runs on a low priority thread, videos that already have a
+// poster are skipped.
+class PosterExtractor : public QObject
+{
+    Q_OBJECT
+public:
+    PosterExtractor();
+    ~PosterExtractor();
+
+    void extract(const QString& videoPath, const QSize& size);
+signals:
+    void extractRequested(const QString& videoPath, const QSize& size);
+
+private:
+    QThread _thread;
+
+    QImage _firstFrame(const QString& videoPath, const QSize& size);
+private slots:
+    void _extract(const QString& videoPath, const QSize& size);
+};
+
+#endif // POSTEREXTRACTOR_H
@@ -0,0 +1,143 @@
+#include "prefetcher.h"
+#include "logger.h"
+#include "mediacache.h"
+
+#include <QFile>
+#include <QImageReader>
+
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+Prefetcher::Prefetcher() : _depth(2), _budget(64 * 1024 * 1024) {
+    moveToThread(&_thread);
+    setObjectName("Prefetcher");
+    _thread.setObjectName("Prefetcher");
+
+    connect(this, &Prefetcher::prefetchRequested, this, &Prefetcher::_prefetch);
+    _thread.start(QThread::LowPriority);
+}
+
+Prefetcher::~Prefetcher() {
+    _thread.quit();
+    _thread.wait();
+}
+
+int Prefetcher::depth() const {
+    return _depth;
+}
+
+void Prefetcher::depth(int entries) {
+    _depth = qMax(0, entries);
+}
+
+void Prefetcher::budget(qint64 bytes) {
+    _budget = qMax(Q_INT64_C(0), bytes);
+}
+
+void Prefetcher::prefetch(const QVector<Entry> &entries) {
+    QStringList files;
+    QStringList images;
+
+    for (auto& entry : entries) {
+        files.append(entry.filePath);
+        if (entry.type == Playlist::Type::IMAGE) {
+            images.append(entry.filePath);
+        } else if (QFile::exists(MediaCache::posterPath(entry.filePath))) {
+            images.append(MediaCache::posterPath(entry.filePath));
+        }
+    }
+
+    emit prefetchRequested(files, images);
+}
+
+QImage Prefetcher::takeImage(const QString &filename) {
+    QMutexLocker lock(&_mutex);
+    return _images.take(filename);
+}
+
+void Prefetcher::_prefetch(const QStringList &files, const QStringList &images) {
+    qint64 remaining = _budget;
+
+    // decoded images are the most expensive thing to redo on the GUI thread, they go first
+    {
+        QMutexLocker lock(&_mutex);
+        for (auto it = _images.begin(); it != _images.end();) {
+            if (images.contains(it.key())) {
+                remaining -= it.value().byteCount();
+                ++it;
+            } else {
+                it = _images.erase(it);
+            }
+        }
+    }
+
+    for (auto& filename : images) {
+        {
+            QMutexLocker lock(&_mutex);
+            if (_images.contains(filename)) {
+                continue;
+            }
+        }
+
+        QImageReader reader(filename);
+        QSize size = reader.size();
+        qint64 decodedBytes = (qint64) size.width() * size.height() * 4;
+        if (! size.isValid() || decodedBytes > remaining) {
+            break;
+        }
+
+        QImage image = reader.read();
+        if (image.isNull()) {
+            qCWarning(lcPrefetch) << Q_FUNC_INFO << "Failed to decode" << filename << reader.errorString();
+            continue;
+        }
+
+        remaining -= image.byteCount();
+        QMutexLocker lock(&_mutex);
+        _images.insert(filename, image);
+    }
+
+    QHash<QString, qint64> hinted;
+    for (auto& filename : files) {
+        qint64 levelBytes = remaining / 2;
+        if (levelBytes <= 0) {
+            break;
+        }
+
+        qint64 bytes = _hinted.value(filename);
+        if (bytes < levelBytes) {
+            bytes = _readAhead(filename, levelBytes);
+        }
+
+        hinted.insert(filename, bytes);
+        remaining -= bytes;
+    }
+    _hinted = hinted;
+}
+
+qint64 Prefetcher::_readAhead(const QString &filename, qint64 bytes) {
+    QFile file(filename);
+    if (! file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+
+    bytes = qMin(bytes, file.size());
+
+#ifdef Q_OS_LINUX
+    posix_fadvise(file.handle(), 0, bytes, POSIX_FADV_WILLNEED);
+#else
+    // no fadvise, pull the head through the page cache by hand
+    QByteArray chunk;
+    for (qint64 read = 0; read < bytes; read += chunk.size()) {
+        chunk = file.read(qMin(bytes - read, Q_INT64_C(1024 * 1024)));
+        if (chunk.isEmpty()) {
+            break;
+        }
+    }
+#endif
+
+    return bytes;
+}
@@ -0,0 +1,49 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include "playlist.h"
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QThread>
+#include <QStringList>
+
+#include <atomic>
+
+// Warms the page cache for the next entries in the rotation and decodes
+// upcoming images ahead of time. The nearest entry gets half of the budget,
+// every further level half of what is left, so a deep lookahead never
+// evicts the file that is about to play.
+class Prefetcher : public QObject
+{
+    Q_OBJECT
+public:
+    Prefetcher();
+    ~Prefetcher();
+
+    int depth() const;
+    void depth(int entries);
+    void budget(qint64 bytes);
+
+    void prefetch(const QVector<Entry>& entries);
+    QImage takeImage(const QString& filename);
+signals:
+    void prefetchRequested(const QStringList& files, const QStringList& images);
+
+private:
+    QThread _thread;
+    QMutex _mutex;
+
+    std::atomic<int> _depth;
+    std::atomic<qint64> _budget;
+
+    QHash<QString, qint64> _hinted;
+    QHash<QString, QImage> _images;
+
+    qint64 _readAhead(const QString& filename, qint64 bytes);
+private slots:
+    void _prefetch(const QStringList& files, const QStringList& images);
+};
+
+#endif // PREFETCHER_H
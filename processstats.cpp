@@ -0,0 +1,52 @@
+#include "processstats.h"
+
+#include <QFile>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+static qint64 _statusValue(const char* key) {
+    QFile status("/proc/self/status");
+    if (! status.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+
+    // e.g. "VmRSS:     123456 kB"
+    for (QByteArray line = status.readLine(); ! line.isEmpty(); line = status.readLine()) {
+        if (line.startsWith(key)) {
+            return line.mid(qstrlen(key)).trimmed().split(' ').first().toLongLong() * 1024;
+        }
+    }
+
+    return -1;
+}
+
+qint64 ProcessStats::residentBytes() {
+    return _statusValue("VmRSS:");
+}
+
+qint64 ProcessStats::peakResidentBytes() {
+    qint64 peak = _statusValue("VmHWM:");
+#ifdef Q_OS_UNIX
+    if (peak < 0) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        peak = (qint64) usage.ru_maxrss * 1024;
+    }
+#endif
+    return peak;
+}
+
+double ProcessStats::cpuSeconds() {
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+            (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,14 @@
+#ifndef PROCESSSTATS_H
+#define PROCESSSTATS_H
+
+#include <QtGlobal>
+
+class ProcessStats
+{
+public:
+    static qint64 residentBytes();
+    static qint64 peakResidentBytes();
+    static double cpuSeconds();
+};
+
+#endif // PROCESSSTATS_H
@@ -0,0 +1,172 @@
+#include "pushchannel.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
+
+static const int _minRetryMillis = 1000;
+static const int _maxRetryMillis = 60000;
+static const int _idleMillis = 90000;
+
+PushChannel::PushChannel(QObject *parent) : QObject(parent), _retryMillis(_minRetryMillis), _backoffMillis(_minRetryMillis) {
+    _retryTimer.setSingleShot(true);
+    _idleTimer.setSingleShot(true);
+    connect(&_retryTimer, &QTimer::timeout, this, &PushChannel::_connect);
+    connect(&_idleTimer, &QTimer::timeout, this, &PushChannel::_onIdle);
+}
+
+// no signals from here, the owner is already on its way down
+PushChannel::~PushChannel() {
+    if (_reply != nullptr) {
+        disconnect(_reply, nullptr, this, nullptr);
+        _reply->abort();
+    }
+}
+
+void PushChannel::open(const QUrl &url) {
+    // unseeded, every screen would draw the same jitter after a server
+    // restart. The url carries the MAC, screens booted together still differ.
+    static bool seeded = [&url] {
+        qsrand(qHash(url.toString()) ^ uint(QDateTime::currentMSecsSinceEpoch()) ^ uint(QCoreApplication::applicationPid()));
+        return true;
+    }();
+    Q_UNUSED(seeded);
+
+    close();
+    _url = url;
+    _backoffMillis = _retryMillis;
+    _connect();
+}
+
+void PushChannel::close() {
+    _retryTimer.stop();
+    _idleTimer.stop();
+    if (_reply != nullptr) {
+        disconnect(_reply, nullptr, this, nullptr);
+        _reply->abort();
+        _reply->deleteLater();
+        _reply = nullptr;
+    }
+    _setConnected(false);
+}
+
+bool PushChannel::isConnected() const {
+    return _connected;
+}
+
+void PushChannel::_setConnected(bool connected) {
+    if (_connected != connected) {
+        _connected = connected;
+        emit this->connected(connected);
+    }
+}
+
+void PushChannel::_connect() {
+    QNetworkRequest request(_url);
+    request.setRawHeader("Accept", "text/event-stream");
+    request.setRawHeader("Cache-Control", "no-cache");
+    request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysNetwork);
+
+    _buffer.clear();
+    _eventType.clear();
+    _eventData.clear();
+    _reply = _nam.get(request);
+    connect(_reply, &QNetworkReply::metaDataChanged, this, &PushChannel::_onMetaDataChanged);
+    connect(_reply, &QNetworkReply::readyRead, this, &PushChannel::_onReadyRead);
+    connect(_reply, &QNetworkReply::finished, this, &PushChannel::_onFinished);
+    _idleTimer.start(_idleMillis);
+}
+
+void PushChannel::_onMetaDataChanged() {
+    int status = _reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    QString contentType = _reply->header(QNetworkRequest::ContentTypeHeader).toString();
+    if (status != 200 || ! contentType.startsWith("text/event-stream")) {
+        qCWarning(lcPlaylist) << Q_FUNC_INFO << "No event stream at" << _url << status << contentType;
+        _reply->abort();
+        return;
+    }
+
+    _backoffMillis = _retryMillis;
+    _setConnected(true);
+}
+
+void PushChannel::_onReadyRead() {
+    _idleTimer.start(_idleMillis);
+
+    _buffer += _reply->readAll();
+    int end;
+    while ((end = _buffer.indexOf('\n')) >= 0) {
+        QByteArray line = _buffer.left(end);
+        _buffer.remove(0, end + 1);
+        if (line.endsWith('\r')) {
+            line.chop(1);
+        }
+        _parseLine(line);
+    }
+}
+
+// event: sequence (or none), data: ..., retry: <ms>, and : for comments
+void PushChannel::_parseLine(const QByteArray &line) {
+    static auto& events = Metrics::counter("disupurei_push_events_total", "Sequence change events pushed by the server");
+
+    if (line.isEmpty()) {
+        // a blank line ends the event, one without data is not dispatched
+        if (! _eventData.isEmpty() && (_eventType.isEmpty() || _eventType == "sequence")) {
+            events.add();
+            emit changed();
+        }
+        _eventType.clear();
+        _eventData.clear();
+        return;
+    }
+
+    if (line.startsWith(':')) {
+        return;
+    }
+
+    int colon = line.indexOf(':');
+    QByteArray field = colon < 0 ? line : line.left(colon);
+    QByteArray value = colon < 0 ? QByteArray() : line.mid(colon + 1);
+    if (value.startsWith(' ')) {
+        value.remove(0, 1);
+    }
+
+    if (field == "event") {
+        _eventType = value;
+    } else if (field == "data") {
+        _eventData += value + '\n';
+    } else if (field == "retry") {
+        bool ok;
+        int millis = value.toInt(&ok);
+        if (ok) {
+            _retryMillis = qBound(_minRetryMillis, millis, _maxRetryMillis);
+        }
+    }
+}
+
+void PushChannel::_onFinished() {
+    static auto& drops = Metrics::counter("disupurei_push_disconnects_total", "Push channel streams that ended or failed to open");
+
+    if (_reply->error() != QNetworkReply::NoError && _reply->error() != QNetworkReply::OperationCanceledError) {
+        qCWarning(lcPlaylist) << Q_FUNC_INFO << "Push channel closed" << _reply->errorString();
+    }
+    _reply->deleteLater();
+    _reply = nullptr;
+    _idleTimer.stop();
+    drops.add();
+    _setConnected(false);
+
+    int delay = _backoffMillis + qrand() % (_backoffMillis / 2 + 1);
+    _backoffMillis = qMin(_backoffMillis * 2, _maxRetryMillis);
+    _retryTimer.start(delay);
+}
+
+void PushChannel::_onIdle() {
+    if (_reply != nullptr) {
+        qCWarning(lcPlaylist) << Q_FUNC_INFO << "Push channel silent for" << _idleMillis / 1000 << "s, reconnecting";
+        _reply->abort();
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef PUSHCHANNEL_H
+#define PUSHCHANNEL_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QTimer>
+#include <QUrl>
+#include <QtNetwork/QNetworkAccessManager>
+
+class QNetworkReply;
+
+// A long-lived server-sent events stream. Every event with data tells that
+// the sequence may have changed. A dropped stream is reopened after a
+// backoff with jitter, so a restarted server is not hit by every screen at
+// once, and a stream that stays silent past the idle timeout counts as
+// dropped. The server is expected to send a comment line as a keepalive
+// well within it.
+class PushChannel : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PushChannel(QObject *parent = 0);
+    ~PushChannel();
+
+    void open(const QUrl& url);
+    void close();
+    bool isConnected() const;
+
+signals:
+    void connected(bool connected);
+    void changed();
+
+private:
+    QNetworkAccessManager _nam;
+    QNetworkReply* _reply = nullptr;
+    QUrl _url;
+    QTimer _retryTimer;
+    QTimer _idleTimer;
+    int _retryMillis;
+    int _backoffMillis;
+    bool _connected = false;
+
+    QByteArray _buffer;
+    QByteArray _eventType;
+    QByteArray _eventData;
+
+    void _setConnected(bool connected);
+    void _parseLine(const QByteArray& line);
+private slots:
+    void _connect();
+    void _onMetaDataChanged();
+    void _onReadyRead();
+    void _onFinished();
+    void _onIdle();
+};
+
+#endif // PUSHCHANNEL_H
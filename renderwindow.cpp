@@ -0,0 +1,201 @@
+#include "renderwindow.h"
+#include "gpustats.h"
+#include "logger.h"
+#include "trace.h"
+
+#include <QExposeEvent>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+RenderLoop::RenderLoop(QWindow *window, bool threaded) : _window(window), _format(window->requestedFormat()) {
+    // parented, so it moves to the render thread along with us
+    _imageTimer.setParent(this);
+    _imageTimer.setSingleShot(true);
+
+    setObjectName("RenderLoop");
+    if (threaded) {
+        moveToThread(&_thread);
+        _thread.setObjectName("RenderLoop");
+    }
+
+    connect(this, &RenderLoop::exposeRequested, this, &RenderLoop::_expose);
+    connect(this, &RenderLoop::showVideoRequested, this, &RenderLoop::_showVideo);
+    connect(this, &RenderLoop::showImageRequested, this, &RenderLoop::_showImage);
+    connect(this, &RenderLoop::renderRequested, this, &RenderLoop::_render);
+    connect(&_imageTimer, &QTimer::timeout, this, &RenderLoop::_render);
+    if (threaded) {
+        _thread.start(QThread::HighPriority);
+    }
+}
+
+RenderLoop::~RenderLoop() {
+    if (! _thread.isRunning()) {
+        _cleanup();
+        return;
+    }
+
+    QMetaObject::invokeMethod(this, "_cleanup", Qt::BlockingQueuedConnection);
+
+    _thread.quit();
+    _thread.wait();
+}
+
+QOpenGLContext *RenderLoop::context() const {
+    return _publishedContext;
+}
+
+VideoRenderer &RenderLoop::video() {
+    return _video;
+}
+
+void RenderLoop::expose(bool exposed, const QSize &size) {
+    emit exposeRequested(exposed, size);
+}
+
+void RenderLoop::showVideo() {
+    emit showVideoRequested();
+}
+
+void RenderLoop::showImage(const QString &filename, int duration, const QImage &image) {
+    emit showImageRequested(filename, duration, image);
+}
+
+// frames arriving faster than they are drawn collapse into one render
+void RenderLoop::requestRender() {
+    if (! _renderPending.exchange(true)) {
+        emit renderRequested();
+    }
+}
+
+void RenderLoop::_expose(bool exposed, const QSize &size) {
+    _exposed = exposed;
+    _size = size;
+    _video.resize(size.width(), size.height());
+    if (! _exposed) {
+        return;
+    }
+
+    if (! _context) {
+        _context = std::unique_ptr<QOpenGLContext>(new QOpenGLContext);
+        _context->setFormat(_format);
+        if (! _context->create() || ! _context->makeCurrent(_window)) {
+            qCWarning(lcPlayer) << Q_FUNC_INFO << "Failed to create a context for the render window";
+            _context.reset();
+            return;
+        }
+
+        _video.initialize(_context.get());
+        _image.initialize(_context.get());
+        _frameTimer.initialize(_context.get());
+        if (! _pendingImage.isNull()) {
+            _openImage(_pendingImage, _pendingImageDuration);
+            _pendingImage = QImage();
+        }
+
+        _publishedContext = _context.get();
+        emit initialized();
+    }
+
+    _render();
+}
+
+void RenderLoop::_showVideo() {
+    _content = Content::VIDEO;
+    _imagePlaying = false;
+    _imageTimer.stop();
+    _render();
+}
+
+void RenderLoop::_showImage(const QString &filename, int duration, const QImage &image) {
+    TRACE_SPAN("RenderLoop::showImage");
+
+    // when threaded, decoding a file that missed the prefetcher only holds up the render thread
+    QImage decoded = image.isNull() ? QImage(filename) : image;
+    _content = Content::IMAGE;
+    if (! _context) {
+        _pendingImage = decoded;
+        _pendingImageDuration = duration;
+        return;
+    }
+
+    _context->makeCurrent(_window);
+    _openImage(decoded, duration);
+    _render();
+}
+
+void RenderLoop::_openImage(const QImage &image, int duration) {
+    _image.open(image, duration);
+    _imagePlaying = true;
+}
+
+void RenderLoop::_render() {
+    _renderPending = false;
+    if (! _context || ! _exposed) {
+        return;
+    }
+
+    TRACE_SPAN("RenderLoop::render");
+
+    _context->makeCurrent(_window);
+    _context->functions()->glViewport(0, 0, _size.width(), _size.height());
+
+    _frameTimer.begin();
+    bool drawn = _content == Content::VIDEO ? _video.render() : _image.render();
+    _frameTimer.end();
+    if (drawn) {
+        GpuStats::sampleMemory();
+    }
+
+    // a threaded loop blocks only its own thread until the swap interval
+    _context->swapBuffers(_window);
+
+    if (drawn) {
+        emit framePresented();
+    }
+
+    if (_content == Content::IMAGE && _imagePlaying) {
+        int next = _image.nextFrameMillis();
+        if (next >= 0) {
+            _imageTimer.start(next);
+        } else {
+            _imagePlaying = false;
+            emit imageFinished();
+        }
+    }
+}
+
+void RenderLoop::_cleanup() {
+    _imageTimer.stop();
+    _publishedContext = nullptr;
+    if (! _context) {
+        return;
+    }
+
+    _context->makeCurrent(_window);
+    _video.cleanup();
+    _image.cleanup();
+    _frameTimer.cleanup();
+    _context->doneCurrent();
+    _context.reset();
+}
+
+RenderWindow::RenderWindow(bool threaded) : _loop(this, threaded) {
+    setSurfaceType(QWindow::OpenGLSurface);
+    setFlags(flags() | Qt::WindowTransparentForInput);
+}
+
+RenderLoop &RenderWindow::loop() {
+    return _loop;
+}
+
+void RenderWindow::exposeEvent(QExposeEvent *event) {
+    Q_UNUSED(event);
+
+    _loop.expose(isExposed(), size() * devicePixelRatio());
+}
+
+void RenderWindow::resizeEvent(QResizeEvent *event) {
+    QWindow::resizeEvent(event);
+
+    _loop.expose(isExposed(), size() * devicePixelRatio());
+}
@@ -0,0 +1,99 @@
+#ifndef RENDERWINDOW_H
+#define RENDERWINDOW_H
+
+#include "gpustats.h"
+#include "imagerenderer.h"
+#include "videorenderer.h"
+
+#include <QImage>
+#include <QSurfaceFormat>
+#include <QThread>
+#include <QTimer>
+#include <QWindow>
+
+#include <atomic>
+#include <memory>
+
+// Draws a RenderWindow to its default framebuffer. A threaded loop runs on
+// a thread of its own, its context is created, made current and swapped on
+// that thread only; everything else reaches it through queued signals, so
+// a busy GUI thread never holds up a frame. Otherwise it draws on the GUI
+// thread like a QOpenGLWindow with NoPartialUpdate.
+class RenderLoop : public QObject
+{
+    Q_OBJECT
+public:
+    RenderLoop(QWindow* window, bool threaded);
+    ~RenderLoop();
+
+    // null until the window was first exposed
+    QOpenGLContext* context() const;
+    // frames and the video size go straight to the renderer from any thread
+    VideoRenderer& video();
+
+    void expose(bool exposed, const QSize& size);
+    void showVideo();
+    void showImage(const QString& filename, int duration, const QImage& image);
+    void requestRender();
+
+signals:
+    void initialized();
+    void framePresented();
+    void imageFinished();
+
+    void exposeRequested(bool exposed, const QSize& size);
+    void showVideoRequested();
+    void showImageRequested(const QString& filename, int duration, const QImage& image);
+    void renderRequested();
+
+private:
+    enum class Content {
+        VIDEO, IMAGE
+    };
+
+    QThread _thread;
+    QWindow* _window;
+    QSurfaceFormat _format;
+    std::unique_ptr<QOpenGLContext> _context;
+    std::atomic<QOpenGLContext*> _publishedContext{nullptr};
+    std::atomic<bool> _renderPending{false};
+
+    VideoRenderer _video;
+    ImageRenderer _image;
+    GpuFrameTimer _frameTimer;
+    Content _content = Content::VIDEO;
+    bool _exposed = false;
+    QSize _size;
+    QTimer _imageTimer;
+    bool _imagePlaying = false;
+    int _pendingImageDuration = 0;
+    QImage _pendingImage;
+
+    void _openImage(const QImage& image, int duration);
+private slots:
+    void _expose(bool exposed, const QSize& size);
+    void _showVideo();
+    void _showImage(const QString& filename, int duration, const QImage& image);
+    void _render();
+    void _cleanup();
+};
+
+// A native window for the WindowSurface, it only forwards exposure and
+// size to its RenderLoop. Input passes through to the widget below.
+class RenderWindow : public QWindow
+{
+    Q_OBJECT
+public:
+    explicit RenderWindow(bool threaded);
+
+    RenderLoop& loop();
+
+protected:
+    void exposeEvent(QExposeEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+
+private:
+    RenderLoop _loop;
+};
+
+#endif // RENDERWINDOW_H
@@ -0,0 +1,168 @@
+#include "shadercache.h"
+#include "logger.h"
+
+#include <QOpenGLContext>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QSaveFile>
+
+#include <QDebug>
+
+#include <cstring>
+
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+static QByteArray glString(QOpenGLFunctions* functions, GLenum name) {
+    return QByteArray(reinterpret_cast<const char*>(functions->glGetString(name)));
+}
+
+ShaderCache::ShaderCache(QOpenGLContext* context) : _functions(context->functions()) {
+    QByteArray getName;
+    QByteArray setName;
+
+    QSurfaceFormat format = context->format();
+    if (context->isOpenGLES()) {
+        if (format.majorVersion() >= 3) {
+            getName = "glGetProgramBinary";
+            setName = "glProgramBinary";
+        } else if (context->hasExtension("GL_OES_get_program_binary")) {
+            getName = "glGetProgramBinaryOES";
+            setName = "glProgramBinaryOES";
+        }
+    } else if (format.version() >= qMakePair(4, 1) || context->hasExtension("GL_ARB_get_program_binary")) {
+        getName = "glGetProgramBinary";
+        setName = "glProgramBinary";
+    }
+
+    if (getName.isEmpty()) {
+        return;
+    }
+
+    GLint binaryFormats = 0;
+    _functions->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    if (binaryFormats <= 0) {
+        return;
+    }
+
+    _getProgramBinary = reinterpret_cast<GetProgramBinary>(context->getProcAddress(getName));
+    _programBinary = reinterpret_cast<ProgramBinary>(context->getProcAddress(setName));
+    if (_getProgramBinary == nullptr || _programBinary == nullptr) {
+        _getProgramBinary = nullptr;
+        _programBinary = nullptr;
+        return;
+    }
+
+    QByteArray driver = glString(_functions, GL_VENDOR) + '\n' +
+            glString(_functions, GL_RENDERER) + '\n' +
+            glString(_functions, GL_VERSION);
+    QString driverKey = QCryptographicHash::hash(driver, QCryptographicHash::Sha1).toHex();
+
+    QDir shaderPath(QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("shaders"));
+    for (auto& staleDriver : shaderPath.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        if (staleDriver != driverKey) {
+            QDir(shaderPath.filePath(staleDriver)).removeRecursively();
+            qCInfo(lcShaders) << "Removed shader cache for previous driver" << staleDriver;
+        }
+    }
+
+    _cacheDir.setPath(shaderPath.filePath(driverKey));
+    if (! _cacheDir.exists()) {
+        _cacheDir.mkpath(".");
+    }
+}
+
+bool ShaderCache::link(QOpenGLShaderProgram &program, const char *vertexSource, const char *fragmentSource) {
+    if (! program.create()) {
+        return false;
+    }
+
+    QString cacheFile;
+    if (_getProgramBinary != nullptr) {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(vertexSource, qstrlen(vertexSource));
+        hash.addData(fragmentSource, qstrlen(fragmentSource));
+        cacheFile = _cacheDir.filePath(hash.result().toHex());
+
+        if (_load(program, cacheFile)) {
+            return true;
+        }
+    }
+
+    if (! program.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource) ||
+        ! program.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource) ||
+        ! program.link()) {
+        qCWarning(lcShaders) << Q_FUNC_INFO << "Failed to link shader program" << program.log();
+        return false;
+    }
+
+    if (_getProgramBinary != nullptr) {
+        _store(program, cacheFile);
+    }
+
+    return true;
+}
+
+bool ShaderCache::_load(QOpenGLShaderProgram &program, const QString &cacheFile) {
+    QFile input(cacheFile);
+    if (! input.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QByteArray data = input.readAll();
+    input.close();
+
+    if (data.size() <= (int) sizeof(quint32)) {
+        input.remove();
+        return false;
+    }
+
+    quint32 binaryFormat;
+    std::memcpy(&binaryFormat, data.constData(), sizeof(binaryFormat));
+    _programBinary(program.programId(), binaryFormat, data.constData() + sizeof(binaryFormat), data.size() - sizeof(binaryFormat));
+
+    // a driver update may reject binaries it produced itself, fall back to source
+    GLint linked = 0;
+    _functions->glGetProgramiv(program.programId(), GL_LINK_STATUS, &linked);
+    if (! linked) {
+        qCInfo(lcShaders) << "Discarding rejected program binary" << cacheFile;
+        input.remove();
+        return false;
+    }
+
+    // with no shaders attached, link() only picks up the status of the loaded binary
+    return program.link();
+}
+
+void ShaderCache::_store(QOpenGLShaderProgram &program, const QString &cacheFile) {
+    GLint length = 0;
+    _functions->glGetProgramiv(program.programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    QByteArray data(length + sizeof(quint32), Qt::Uninitialized);
+    GLsizei written = 0;
+    GLenum binaryFormat = 0;
+    _getProgramBinary(program.programId(), length, &written, &binaryFormat, data.data() + sizeof(quint32));
+    if (written <= 0) {
+        return;
+    }
+
+    quint32 storedFormat = binaryFormat;
+    std::memcpy(data.data(), &storedFormat, sizeof(storedFormat));
+    data.truncate(written + sizeof(quint32));
+
+    QSaveFile output(cacheFile);
+    if (! output.open(QIODevice::WriteOnly)) {
+        qCWarning(lcShaders) << Q_FUNC_INFO << "Failed to open" << cacheFile;
+        return;
+    }
+    output.write(data);
+    output.commit();
+}
@@ -0,0 +1,34 @@
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include <QDir>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+
+class QOpenGLContext;
+
+// Persists linked program binaries under <cache>/shaders/<driver>/, so
+// initializeGL can skip GLSL compilation on every launch after the first.
+// The driver directory is derived from GL_VENDOR/GL_RENDERER/GL_VERSION,
+// binaries from a previous driver are removed when the driver changes.
+class ShaderCache
+{
+public:
+    explicit ShaderCache(QOpenGLContext* context);
+
+    bool link(QOpenGLShaderProgram& program, const char* vertexSource, const char* fragmentSource);
+
+private:
+    typedef void (QOPENGLF_APIENTRYP GetProgramBinary)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+    typedef void (QOPENGLF_APIENTRYP ProgramBinary)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+
+    QOpenGLFunctions* _functions;
+    GetProgramBinary _getProgramBinary = nullptr;
+    ProgramBinary _programBinary = nullptr;
+    QDir _cacheDir;
+
+    bool _load(QOpenGLShaderProgram& program, const QString& cacheFile);
+    void _store(QOpenGLShaderProgram& program, const QString& cacheFile);
+};
+
+#endif // SHADERCACHE_H
@@ -0,0 +1,61 @@
+#include "startupprofile.h"
+#include "logger.h"
+
+#include <QMutex>
+#include <QVector>
+#include <QThread>
+#include <QElapsedTimer>
+
+#include <QDebug>
+
+#include <atomic>
+
+struct StartupPhase {
+    const char* name;
+    qint64 nsecs;
+    QString thread;
+};
+
+static QMutex _mutex;
+static QElapsedTimer _elapsed;
+static QVector<StartupPhase> _phases;
+static std::atomic<bool> _finished(false);
+
+void StartupProfile::mark(const char *phase) {
+    if (_finished) {
+        return;
+    }
+
+    QMutexLocker lock(&_mutex);
+    if (! _elapsed.isValid()) {
+        _elapsed.start();
+    }
+
+    QString thread = QThread::currentThread()->objectName();
+    if (thread.isEmpty()) {
+        thread = QString("0x%1").arg((quintptr) QThread::currentThreadId(), 0, 16);
+    }
+
+    _phases.append({phase, _elapsed.nsecsElapsed(), thread});
+}
+
+void StartupProfile::finish() {
+    if (_finished) {
+        return;
+    }
+
+    mark("first frame");
+    if (_finished.exchange(true)) {
+        return;
+    }
+
+    QMutexLocker lock(&_mutex);
+    qCInfo(lcStartup, "Startup profile:");
+    qint64 previous = 0;
+    for (auto& phase : _phases) {
+        qCInfo(lcStartup, "  %8.1f ms  (+%7.1f ms)  %-24s [%s]",
+              phase.nsecs / 1000000.0, (phase.nsecs - previous) / 1000000.0,
+              phase.name, qPrintable(phase.thread));
+        previous = phase.nsecs;
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef STARTUPPROFILE_H
+#define STARTUPPROFILE_H
+
+// Named timestamps from process start until the first frame is on screen.
+// mark() is thread safe, finish() prints the collected phases once.
+class StartupProfile
+{
+public:
+    static void mark(const char* phase);
+    static void finish();
+};
+
+#endif // STARTUPPROFILE_H
@@ -0,0 +1,124 @@
+#include "supervisor.h"
+#include "imagerenderer.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <QCoreApplication>
+
+// the image player fades in and out around durationMillis
+static const int _imageFadeMillis = 2 * ImageRenderer::fadeMillis;
+
+PlaybackSupervisor::PlaybackSupervisor(QObject *parent) : QObject(parent) {
+    _deadline.setSingleShot(true);
+    connect(&_deadline, &QTimer::timeout, this, &PlaybackSupervisor::_onDeadline);
+}
+
+void PlaybackSupervisor::timeouts(int firstFrameMillis, int graceMillis, int maxVideoMillis) {
+    _firstFrameMillis = qMax(1000, firstFrameMillis);
+    _graceMillis = qMax(0, graceMillis);
+    _maxVideoMillis = qMax(1000, maxVideoMillis);
+}
+
+void PlaybackSupervisor::restartEnabled(bool enabled) {
+    _restartEnabled = enabled;
+}
+
+void PlaybackSupervisor::entryStarted(const Entry &entry) {
+    // an entry that showed a frame and ended on its own, the player is healthy again
+    if (! _intervening && _framePresented) {
+        _level = 0;
+    }
+    _intervening = false;
+
+    _type = entry.type;
+    _fileId = entry.fileId;
+    _expectedMillis = entry.type == Playlist::Type::IMAGE ? entry.durationMillis + _imageFadeMillis : 0;
+    _framePresented = false;
+    _entryClock.start();
+    _deadline.start(_firstFrameMillis);
+}
+
+void PlaybackSupervisor::stop() {
+    _deadline.stop();
+    _recovering = false;
+}
+
+void PlaybackSupervisor::framePresented() {
+    static auto& recoveryLatency = Metrics::histogram("disupurei_recovery_seconds", "Time from detecting a stalled entry until a frame is on screen again",
+                                                      {0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30});
+
+    if (_framePresented) {
+        return;
+    }
+    _framePresented = true;
+
+    if (_recovering) {
+        _recovering = false;
+        recoveryLatency.observe(_recoveryClock.elapsed() / 1000.0);
+    }
+
+    _armEndDeadline();
+}
+
+void PlaybackSupervisor::videoDuration(qint64 millis) {
+    if (_type != Playlist::Type::VIDEO || millis <= 0) {
+        return;
+    }
+
+    _expectedMillis = (int) qMin<qint64>(millis, _maxVideoMillis);
+    if (_framePresented) {
+        _armEndDeadline();
+    }
+}
+
+void PlaybackSupervisor::_armEndDeadline() {
+    int expected = _expectedMillis > 0 ? _expectedMillis : _maxVideoMillis;
+    int remaining = (int) qMax<qint64>(0, expected - _entryClock.elapsed());
+    _deadline.start(remaining + _graceMillis);
+}
+
+void PlaybackSupervisor::_onDeadline() {
+    static auto& skips = Metrics::counter("disupurei_recovery_skip_total", "Stalled entries recovered by skipping them");
+    static auto& rebuilds = Metrics::counter("disupurei_recovery_rebuild_pipeline_total", "Stalls recovered by rebuilding the video pipeline");
+    static auto& recreates = Metrics::counter("disupurei_recovery_recreate_players_total", "Stalls recovered by recreating the players");
+    static auto& restarts = Metrics::counter("disupurei_recovery_restart_total", "Stalls recovered by restarting the process");
+    static auto& detection = Metrics::histogram("disupurei_stall_detected_seconds", "Time into an entry when it was found stalled",
+                                                {1, 5, 15, 30, 60, 300, 1800});
+
+    detection.observe(_entryClock.elapsed() / 1000.0);
+
+    Recovery recovery = static_cast<Recovery>(qMin(++_level, (int) Recovery::RESTART));
+    if (recovery == Recovery::RESTART && ! _restartEnabled) {
+        recovery = Recovery::RECREATE_PLAYERS;
+    }
+
+    qCWarning(lcPlayer) << "Entry" << _fileId << (_framePresented ? "overran its end" : "never showed a frame")
+                        << "after" << _entryClock.elapsed() << "ms, recovering with" << recovery;
+
+    _recovering = true;
+    _recoveryClock.start();
+    _intervening = true;
+
+    switch (recovery) {
+    case Recovery::NONE:
+    case Recovery::SKIP:
+        skips.add();
+        break;
+    case Recovery::REBUILD_PIPELINE:
+        rebuilds.add();
+        emit rebuildPipelineRequested();
+        break;
+    case Recovery::RECREATE_PLAYERS:
+        recreates.add();
+        emit recreatePlayersRequested();
+        break;
+    case Recovery::RESTART:
+        restarts.add();
+        // starting the new process is left to the service manager, a
+        // second instance of our own would race this one for the display
+        QCoreApplication::exit(3);
+        return;
+    }
+
+    emit skipRequested();
+}
@@ -0,0 +1,67 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include "playlist.h"
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+
+// Watches every entry for its first frame and for its expected end, from
+// durationMillis for images or the queried duration for videos. An entry
+// that overruns is recovered with escalating steps as long as the failures
+// follow each other: skip the entry, rebuild the video pipeline, recreate
+// the players, restart the process.
+class PlaybackSupervisor : public QObject
+{
+    Q_OBJECT
+public:
+    enum class Recovery {
+        NONE,
+        SKIP,
+        REBUILD_PIPELINE,
+        RECREATE_PLAYERS,
+        RESTART
+    };
+    Q_ENUM(Recovery)
+
+    explicit PlaybackSupervisor(QObject *parent = 0);
+
+    void timeouts(int firstFrameMillis, int graceMillis, int maxVideoMillis);
+    void restartEnabled(bool enabled);
+
+    void entryStarted(const Entry& entry);
+    // nothing plays, nothing to watch until the next entryStarted()
+    void stop();
+    void framePresented();
+    void videoDuration(qint64 millis);
+
+signals:
+    void skipRequested();
+    void rebuildPipelineRequested();
+    void recreatePlayersRequested();
+
+private:
+    QTimer _deadline;
+    QElapsedTimer _entryClock;
+    QElapsedTimer _recoveryClock;
+
+    Playlist::Type _type = Playlist::Type::IMAGE;
+    QString _fileId;
+    int _expectedMillis = 0;
+    bool _framePresented = false;
+    bool _intervening = false;
+    bool _recovering = false;
+    int _level = 0;
+
+    int _firstFrameMillis = 15000;
+    int _graceMillis = 10000;
+    int _maxVideoMillis = 30 * 60 * 1000;
+    bool _restartEnabled = true;
+
+    void _armEndDeadline();
+private slots:
+    void _onDeadline();
+};
+
+#endif // SUPERVISOR_H
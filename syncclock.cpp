@@ -0,0 +1,125 @@
+#include "syncclock.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include <gst/net/gstnet.h>
+
+static SyncClock::Role _role = SyncClock::Role::OFF;
+static GstClock* _clock = nullptr;
+static GstNetTimeProvider* _provider = nullptr;
+static GstClockTime _boundary = GST_SECOND;
+static GstClockTime _lead = 500 * GST_MSECOND;
+
+static void _onSynced(GstClock* clock, gboolean synced, gpointer data) {
+    Q_UNUSED(clock)
+    Q_UNUSED(data)
+
+    if (synced) {
+        qCInfo(lcSync) << "Synchronized to the network clock";
+    } else {
+        qCWarning(lcSync) << "Lost the network clock, playback runs on the local estimate";
+    }
+}
+
+SyncClock::Role SyncClock::roleFromString(const QString &role, bool *ok) {
+    *ok = true;
+    if (role.compare("off", Qt::CaseInsensitive) == 0) {
+        return Role::OFF;
+    } else if (role.compare("provider", Qt::CaseInsensitive) == 0) {
+        return Role::PROVIDER;
+    } else if (role.compare("client", Qt::CaseInsensitive) == 0) {
+        return Role::CLIENT;
+    }
+
+    *ok = false;
+    return Role::OFF;
+}
+
+void SyncClock::start(Role role, const QString &address, int port, int boundaryMillis, int leadMillis) {
+    stop();
+
+    _boundary = qMax(40, boundaryMillis) * GST_MSECOND;
+    _lead = qMax(0, leadMillis) * GST_MSECOND;
+
+    QByteArray host = address.toUtf8();
+    switch (role) {
+    case Role::OFF:
+        return;
+    case Role::PROVIDER:
+        _clock = gst_system_clock_obtain();
+        // an empty address binds to all interfaces
+        _provider = gst_net_time_provider_new(_clock, host.isEmpty() ? NULL : host.constData(), port);
+        if (_provider == nullptr) {
+            qCWarning(lcSync) << Q_FUNC_INFO << "Failed to provide the clock on port" << port;
+            stop();
+            return;
+        }
+        qCInfo(lcSync) << "Providing the clock on port" << port;
+        break;
+    case Role::CLIENT:
+        if (host.isEmpty()) {
+            qCWarning(lcSync) << Q_FUNC_INFO << "No clock provider address set";
+            return;
+        }
+        _clock = gst_net_client_clock_new("disupurei-sync", host.constData(), port, 0);
+        g_signal_connect(_clock, "synced", G_CALLBACK(_onSynced), NULL);
+        qCInfo(lcSync) << "Following the clock at" << address << "port" << port;
+        break;
+    }
+
+    _role = role;
+    Metrics::collector([] {
+        static auto& synced = Metrics::gauge("disupurei_sync_synced", "Whether the playback clock is synchronized to the network clock");
+        synced.set(SyncClock::synced() ? 1 : 0);
+    });
+}
+
+void SyncClock::stop() {
+    if (_provider != nullptr) {
+        gst_object_unref(_provider);
+        _provider = nullptr;
+    }
+    if (_clock != nullptr) {
+        g_signal_handlers_disconnect_by_func(_clock, (gpointer) _onSynced, NULL);
+        gst_object_unref(_clock);
+        _clock = nullptr;
+    }
+    _role = Role::OFF;
+}
+
+bool SyncClock::enabled() {
+    return _clock != nullptr;
+}
+
+bool SyncClock::synced() {
+    if (_clock == nullptr) {
+        return false;
+    }
+    return _role == Role::PROVIDER || gst_clock_is_synced(_clock);
+}
+
+GstClock *SyncClock::clock() {
+    return _clock;
+}
+
+GstClockTime SyncClock::now() {
+    return _clock != nullptr ? gst_clock_get_time(_clock) : GST_CLOCK_TIME_NONE;
+}
+
+GstClockTime SyncClock::nextBoundary() {
+    GstClockTime earliest = now();
+    if (! GST_CLOCK_TIME_IS_VALID(earliest)) {
+        return GST_CLOCK_TIME_NONE;
+    }
+
+    earliest += _lead;
+    return (earliest / _boundary + 1) * _boundary;
+}
+
+qint64 SyncClock::millisUntil(GstClockTime time) {
+    GstClockTime current = now();
+    if (! GST_CLOCK_TIME_IS_VALID(time) || ! GST_CLOCK_TIME_IS_VALID(current) || time <= current) {
+        return 0;
+    }
+    return (time - current) / GST_MSECOND;
+}
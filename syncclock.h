@@ -0,0 +1,39 @@
+#ifndef SYNCCLOCK_H
+#define SYNCCLOCK_H
+
+#include <gst/gst.h>
+
+#include <QString>
+
+// Shared playback clock for players running side by side. One instance
+// (or any other host) provides its system clock on the network, every
+// instance slaves a GstNetClientClock to it. Entries start on multiples
+// of the boundary in that clock, and video pipelines run on it with the
+// boundary as their base time, so instances playing the same sequence
+// change entries and present frames at the same instant.
+class SyncClock
+{
+public:
+    enum class Role {
+        OFF, PROVIDER, CLIENT
+    };
+
+    static Role roleFromString(const QString& role, bool* ok);
+
+    // needs gst_init, the provider also clocks its own playback
+    static void start(Role role, const QString& address, int port, int boundaryMillis, int leadMillis);
+    static void stop();
+
+    static bool enabled();
+    static bool synced();
+
+    // borrowed, null while sync is off
+    static GstClock* clock();
+
+    static GstClockTime now();
+    // the first boundary that leaves at least the lead time for prerolling
+    static GstClockTime nextBoundary();
+    static qint64 millisUntil(GstClockTime time);
+};
+
+#endif // SYNCCLOCK_H
@@ -0,0 +1,326 @@
+#include "trace.h"
+#include "logger.h"
+
+#include <QDir>
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QCoreApplication>
+#include <QSocketNotifier>
+
+#include <atomic>
+#include <cstring>
+
+#define GST_USE_UNSTABLE_API
+#include <gst/gst.h>
+#include <gst/gsttracer.h>
+
+#ifdef Q_OS_UNIX
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+struct TraceEvent {
+    std::atomic<quint64> sequence;
+    qint64 timestamp;
+    qint64 duration;
+    quint64 id;
+    int thread;
+    char phase;
+    const char* category;
+    char name[48];
+};
+
+// power of two, about 1.3 MB, several minutes of playback
+static const quint64 _capacity = 16384;
+static TraceEvent _events[_capacity];
+static std::atomic<quint64> _next(0);
+
+static QElapsedTimer _clock;
+static std::atomic<bool> _clockStarted(false);
+static QMutex _clockMutex;
+
+static QMutex _threadMutex;
+static QHash<int, QString> _threadNames;
+static std::atomic<int> _nextThread(1);
+
+static qint64 _now() {
+    if (! _clockStarted.load(std::memory_order_acquire)) {
+        QMutexLocker lock(&_clockMutex);
+        if (! _clock.isValid()) {
+            _clock.start();
+        }
+        _clockStarted.store(true, std::memory_order_release);
+    }
+    return _clock.nsecsElapsed();
+}
+
+static int _threadId() {
+    static thread_local int id = 0;
+    if (id == 0) {
+        id = _nextThread++;
+        QString name = QThread::currentThread() ? QThread::currentThread()->objectName() : QString();
+        if (name.isEmpty()) {
+            name = QString("thread %1").arg(id);
+        }
+
+        QMutexLocker lock(&_threadMutex);
+        _threadNames[id] = name;
+    }
+    return id;
+}
+
+// a slot is claimed by bumping _next, its sequence is 0 while it is being
+// written, so dump() skips slots that are torn or have been lapped
+static void _record(char phase, const char* name, const char* category, qint64 timestamp, qint64 duration = 0, quint64 id = 0) {
+    quint64 index = _next.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent& event = _events[index & (_capacity - 1)];
+
+    event.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.timestamp = timestamp;
+    event.duration = duration;
+    event.id = id;
+    event.thread = _threadId();
+    event.phase = phase;
+    event.category = category;
+    qstrncpy(event.name, name, sizeof(event.name));
+    event.sequence.store(index + 1, std::memory_order_release);
+}
+
+Trace::Span::Span(const char *name, const char *category) :
+    _name(name),
+    _category(category),
+    _start(_now()) {
+}
+
+Trace::Span::~Span() {
+    qint64 end = _now();
+    _record('X', _name, _category, _start, end - _start);
+}
+
+void Trace::instant(const char *name, const char *category) {
+    _record('i', name, category, _now());
+}
+
+void Trace::begin(const char *name, const char *category) {
+    _record('B', name, category, _now());
+}
+
+void Trace::end(const char *name, const char *category) {
+    _record('E', name, category, _now());
+}
+
+void Trace::asyncBegin(const char *name, quint64 id, const char *category) {
+    _record('b', name, category, _now(), 0, id);
+}
+
+void Trace::asyncEnd(const char *name, quint64 id, const char *category) {
+    _record('e', name, category, _now(), 0, id);
+}
+
+static QByteArray _jsonString(const char* value) {
+    QByteArray escaped;
+    for (const char* c = value; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            escaped += '\\';
+            escaped += *c;
+        } else if ((unsigned char) *c < 0x20) {
+            escaped += ' ';
+        } else {
+            escaped += *c;
+        }
+    }
+    return '"' + escaped + '"';
+}
+
+bool Trace::dump(const QString &path) {
+    QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    {
+        QMutexLocker lock(&_threadMutex);
+        for (auto it = _threadNames.constBegin(); it != _threadNames.constEnd(); ++it) {
+            out += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" + pid +
+                    ",\"tid\":" + QByteArray::number(it.key()) +
+                    ",\"args\":{\"name\":" + _jsonString(it.value().toUtf8().constData()) + "}},\n";
+        }
+    }
+
+    quint64 last = _next.load(std::memory_order_acquire);
+    quint64 first = last > _capacity ? last - _capacity : 0;
+    int written = 0;
+    for (quint64 index = first; index < last; index++) {
+        TraceEvent& slot = _events[index & (_capacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != index + 1) {
+            continue;
+        }
+
+        TraceEvent event;
+        event.timestamp = slot.timestamp;
+        event.duration = slot.duration;
+        event.id = slot.id;
+        event.thread = slot.thread;
+        event.phase = slot.phase;
+        event.category = slot.category;
+        std::memcpy(event.name, slot.name, sizeof(event.name));
+        if (slot.sequence.load(std::memory_order_acquire) != index + 1) {
+            continue;
+        }
+
+        out += "{\"ph\":\"" + QByteArray(1, event.phase) + "\",\"name\":" + _jsonString(event.name) +
+                ",\"cat\":" + _jsonString(event.category) +
+                ",\"pid\":" + pid + ",\"tid\":" + QByteArray::number(event.thread) +
+                ",\"ts\":" + QByteArray::number(event.timestamp / 1000.0, 'f', 3);
+        if (event.phase == 'X') {
+            out += ",\"dur\":" + QByteArray::number(event.duration / 1000.0, 'f', 3);
+        } else if (event.phase == 'i') {
+            out += ",\"s\":\"t\"";
+        } else if (event.phase == 'b' || event.phase == 'e') {
+            out += ",\"id\":\"0x" + QByteArray::number(event.id, 16) + '"';
+        }
+        out += "},\n";
+        written++;
+    }
+
+    // trailing comma is fine for the trace viewers, but not for JSON parsers
+    if (out.endsWith(",\n")) {
+        out.chop(2);
+    }
+    out += "\n]}\n";
+
+    QSaveFile output(path);
+    if (! output.open(QIODevice::WriteOnly)) {
+        qCWarning(lcTrace) << Q_FUNC_INFO << "Failed to open" << path;
+        return false;
+    }
+    output.write(out);
+    if (! output.commit()) {
+        return false;
+    }
+
+    qCInfo(lcTrace) << "Wrote" << written << "trace events to" << path;
+    return true;
+}
+
+#ifdef Q_OS_UNIX
+static int _signalSockets[2] = {-1, -1};
+
+static void _onSignal(int) {
+    char byte = 1;
+    ssize_t ignored = ::write(_signalSockets[0], &byte, sizeof(byte));
+    Q_UNUSED(ignored)
+}
+#endif
+
+void Trace::installSignalHandler(const QString &directory) {
+#ifdef Q_OS_UNIX
+    if (_signalSockets[0] != -1) {
+        return;
+    }
+
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, _signalSockets) != 0) {
+        qCWarning(lcTrace) << Q_FUNC_INFO << "Failed to create signal socket pair";
+        return;
+    }
+
+    // the handler only writes to the socket, the dump runs on the event loop
+    QSocketNotifier* notifier = new QSocketNotifier(_signalSockets[1], QSocketNotifier::Read, QCoreApplication::instance());
+    QObject::connect(notifier, &QSocketNotifier::activated, [directory](int socket) {
+        char byte;
+        ssize_t ignored = ::read(socket, &byte, sizeof(byte));
+        Q_UNUSED(ignored)
+
+        QDir().mkpath(directory);
+        dump(QDir(directory).filePath(QString("trace-%1.json").arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss"))));
+    });
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = _onSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, nullptr);
+#else
+    Q_UNUSED(directory)
+#endif
+}
+
+// GStreamer tracer hooks, with the element name in the event so the spans
+// line up with our own pipeline spans on the same timeline
+typedef struct {
+    GstTracer parent;
+} DisupureiTracer;
+
+typedef struct {
+    GstTracerClass parent_class;
+} DisupureiTracerClass;
+
+G_DEFINE_TYPE(DisupureiTracer, disupurei_tracer, GST_TYPE_TRACER)
+
+static void _stateChangeName(char* buffer, size_t size, GstElement* element, GstStateChange transition) {
+    g_snprintf(buffer, size, "%s %s>%s", GST_OBJECT_NAME(element),
+               gst_element_state_get_name(GST_STATE_TRANSITION_CURRENT(transition)),
+               gst_element_state_get_name(GST_STATE_TRANSITION_NEXT(transition)));
+}
+
+static void _onStateChangePre(GObject* tracer, guint64 ts, GstElement* element, GstStateChange transition) {
+    Q_UNUSED(tracer)
+    Q_UNUSED(ts)
+
+    char name[48];
+    _stateChangeName(name, sizeof(name), element, transition);
+    _record('B', name, "gstreamer", _now());
+}
+
+static void _onStateChangePost(GObject* tracer, guint64 ts, GstElement* element, GstStateChange transition, GstStateChangeReturn result) {
+    Q_UNUSED(tracer)
+    Q_UNUSED(ts)
+    Q_UNUSED(result)
+
+    char name[48];
+    _stateChangeName(name, sizeof(name), element, transition);
+    _record('E', name, "gstreamer", _now());
+}
+
+static void _onPostMessage(GObject* tracer, guint64 ts, GstElement* element, GstMessage* message) {
+    Q_UNUSED(tracer)
+    Q_UNUSED(ts)
+
+    switch (GST_MESSAGE_TYPE(message)) {
+    case GST_MESSAGE_ASYNC_DONE:
+    case GST_MESSAGE_EOS:
+    case GST_MESSAGE_ERROR:
+    case GST_MESSAGE_WARNING:
+    case GST_MESSAGE_QOS: {
+        char name[48];
+        g_snprintf(name, sizeof(name), "%s %s", GST_OBJECT_NAME(element), GST_MESSAGE_TYPE_NAME(message));
+        _record('i', name, "gstreamer", _now());
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void disupurei_tracer_init(DisupureiTracer* self) {
+    GstTracer* tracer = GST_TRACER(self);
+    gst_tracing_register_hook(tracer, "element-change-state-pre", G_CALLBACK(_onStateChangePre));
+    gst_tracing_register_hook(tracer, "element-change-state-post", G_CALLBACK(_onStateChangePost));
+    gst_tracing_register_hook(tracer, "element-post-message-pre", G_CALLBACK(_onPostMessage));
+}
+
+static void disupurei_tracer_class_init(DisupureiTracerClass* klass) {
+    Q_UNUSED(klass)
+}
+
+void Trace::installGstreamerHooks() {
+    static GObject* tracer = nullptr;
+    if (tracer == nullptr) {
+        // lives for the rest of the process, hooks are never unregistered
+        tracer = G_OBJECT(g_object_new(disupurei_tracer_get_type(), NULL));
+    }
+}
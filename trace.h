@@ -0,0 +1,41 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <QElapsedTimer>
+
+// Lightweight spans for the playback path (download, next entry, pipeline
+// state changes, first buffer, upload, paint), recorded into a fixed ring
+// and written out as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+// on SIGUSR1 or Trace::dump(). GStreamer element state changes and bus
+// messages are recorded on the same timeline through a tracer hook.
+class Trace
+{
+public:
+    class Span {
+    public:
+        explicit Span(const char* name, const char* category = "disupurei");
+        ~Span();
+    private:
+        const char* _name;
+        const char* _category;
+        qint64 _start;
+    };
+
+    static void instant(const char* name, const char* category = "disupurei");
+    static void begin(const char* name, const char* category);
+    static void end(const char* name, const char* category);
+    // spans that start and end in different places, or on different threads
+    static void asyncBegin(const char* name, quint64 id, const char* category = "disupurei");
+    static void asyncEnd(const char* name, quint64 id, const char* category = "disupurei");
+
+    static bool dump(const QString& path);
+    static void installSignalHandler(const QString& directory);
+    static void installGstreamerHooks();
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(...) Trace::Span TRACE_CONCAT(_traceSpan, __LINE__)(__VA_ARGS__)
+
+#endif // TRACE_H
@@ -0,0 +1,37 @@
+#ifndef VIDEOFRAME_H
+#define VIDEOFRAME_H
+
+#include <qopengl.h>
+
+#include <memory>
+
+// A decoded frame as the pipeline hands it to the renderer, one GL texture
+// per plane in the decoder's own format. Converting to RGB is left to the
+// draw shader. kr/kb are the luma coefficients of the colour matrix, a
+// studio range frame has luma in 16-235 and chroma in 16-240.
+//
+// The textures stay valid as long as a copy of the frame holds the
+// mapping. sync is the GLsync the producer placed after writing them, the
+// renderer waits on it in its own context before sampling. A texture may be
+// larger than its plane, texScale is the part of it the plane covers.
+// generation is what GstreamerPipeline::open() returned for the file it
+// was decoded from.
+struct VideoFrame {
+    enum class Format {
+        RGBA, NV12, I420
+    };
+
+    Format format = Format::RGBA;
+    GLuint textures[3] = {0, 0, 0};
+    float texScale[3][2] = {{1, 1}, {1, 1}, {1, 1}};
+    double kr = 0.299;
+    double kb = 0.114;
+    bool fullRange = false;
+    void* sync = nullptr;
+    int generation = 0;
+    std::shared_ptr<void> mapping;
+
+    bool isValid() const { return textures[0] != 0; }
+};
+
+#endif // VIDEOFRAME_H
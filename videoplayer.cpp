@@ -1,33 +1,52 @@
 #include "videoplayer.h"
+#include "gpustats.h"
+#include "startupprofile.h"
+#include "trace.h"
 
-#include <QGuiApplication>
 #include <QTimer>
 
-#include <QOpenGLShaderProgram>
-#include <QOpenGLTexture>
-#include <QMouseEvent>
-
-#define PROGRAM_VERTEX_ATTRIBUTE 0
-#define PROGRAM_TEXCOORD_ATTRIBUTE 1
-
 VideoPlayer::VideoPlayer(QWidget *parent)
-    : QOpenGLWidget(parent),
-      clearColor(Qt::black)
+    : QOpenGLWidget(parent)
 {
 }
 
 VideoPlayer::~VideoPlayer() {
+    _pipeline.reset();
+
     makeCurrent();
-    vbo.destroy();
+    _renderer.cleanup();
+    _frameTimer.cleanup();
     doneCurrent();
 }
 
-void VideoPlayer::open(const QString &filename) {
-    _pipeline->open(filename);
+void VideoPlayer::open(const QString &filename, quint64 startTime) {
+    // a freshly created player has no context until it is first shown
+    if (! isValid()) {
+        _pendingFile = filename;
+        _pendingStartTime = startTime;
+        return;
+    }
+
+    if (! _pipeline) {
+        initPipeline();
+    }
+
+    _renderer.generation(_pipeline->open(filename, startTime));
 }
 
 void VideoPlayer::stop() {
-    _pipeline->stop();
+    _pendingFile.clear();
+    if (_pipeline) {
+        _pipeline->stop();
+    }
+}
+
+void VideoPlayer::resetPipeline() {
+    _pipeline.reset();
+    _renderer.clear();
+    if (isValid()) {
+        initPipeline();
+    }
 }
 
 QSize VideoPlayer::minimumSizeHint() const
@@ -42,155 +61,76 @@ QSize VideoPlayer::sizeHint() const
 
 void VideoPlayer::setClearColor(const QColor &color)
 {
-    clearColor = color;
+    _renderer.clearColor(color);
+    update();
+}
+
+void VideoPlayer::poster(const QImage &image)
+{
+    _renderer.poster(image);
     update();
 }
 
 void VideoPlayer::initializeGL()
 {
-    initializeOpenGLFunctions();
-    makeObject();
-
-    QOpenGLShader *vshader = new QOpenGLShader(QOpenGLShader::Vertex, this);
-    const char *vsrc =
-            "attribute highp vec4 vertex;\n"
-            "attribute mediump vec4 texCoord;\n"
-            "varying mediump vec4 texc;\n"
-            "uniform mediump mat4 matrix;\n"
-            "void main(void)\n"
-            "{\n"
-            "    gl_Position = matrix * vertex;\n"
-            "    texc = texCoord;\n"
-            "}\n";
-    vshader->compileSourceCode(vsrc);
-
-    QOpenGLShader *fshader = new QOpenGLShader(QOpenGLShader::Fragment, this);
-    const char *fsrc =
-            "uniform sampler2D texture;\n"
-            "varying mediump vec4 texc;\n"
-            "void main(void)\n"
-            "{\n"
-            "    gl_FragColor = texture2D(texture, texc.st);\n"
-            "}\n";
-    fshader->compileSourceCode(fsrc);
-
-    program = std::unique_ptr<QOpenGLShaderProgram>(new QOpenGLShaderProgram);
-    program->addShader(vshader);
-    program->addShader(fshader);
-    program->bindAttributeLocation("vertex", PROGRAM_VERTEX_ATTRIBUTE);
-    program->bindAttributeLocation("texCoord", PROGRAM_TEXCOORD_ATTRIBUTE);
-    program->link();
-
-    program->bind();
-    program->setUniformValue("texture", 0);
+    _renderer.initialize(context());
+    _frameTimer.initialize(context());
+
+    StartupProfile::mark("initializeGL (video)");
+
+    if (! _pendingFile.isEmpty()) {
+        QString filename = _pendingFile;
+        quint64 startTime = _pendingStartTime;
+        _pendingFile.clear();
+        QTimer::singleShot(0, this, [this, filename, startTime] {
+            open(filename, startTime);
+        });
+    }
 }
 
 void VideoPlayer::paintGL() {
-    glClearColor(clearColor.redF(), clearColor.greenF(), clearColor.blueF(), clearColor.alphaF());
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    program->setUniformValue("matrix", matrix);
-    program->enableAttributeArray(PROGRAM_VERTEX_ATTRIBUTE);
-    program->enableAttributeArray(PROGRAM_TEXCOORD_ATTRIBUTE);
-    program->setAttributeBuffer(PROGRAM_VERTEX_ATTRIBUTE, GL_FLOAT, 0, 3, 5 * sizeof(GLfloat));
-    program->setAttributeBuffer(PROGRAM_TEXCOORD_ATTRIBUTE, GL_FLOAT, 3 * sizeof(GLfloat), 2, 5 * sizeof(GLfloat));
-
-    glBindTexture (GL_TEXTURE_2D, textureId);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-
-    if (_pipeline) {
-        _pipeline->frameDrawn();
+    TRACE_SPAN("VideoPlayer::paintGL");
+
+    _frameTimer.begin();
+    bool drawn = _renderer.render();
+    _frameTimer.end();
+    if (drawn) {
+        GpuStats::sampleMemory();
+        emit framePresented();
     }
 }
 
 void VideoPlayer::resizeGL(int width, int height) {
-    glViewport(0, 0, width, height);
-
-    makeObject();
-}
-
-void VideoPlayer::makeObject() {
-    static const GLfloat coords[6][3] =
-        { { -1.0f, -1.0f,  0.0f },
-          {  1.0f, -1.0f,  0.0f },
-          { -1.0f,  1.0f,  0.0f },
-          { -1.0f,  1.0f,  0.0f },
-          {  1.0f,  1.0f,  0.0f },
-          {  1.0f, -1.0f,  0.0f } };
-
-    QVector<GLfloat> vertData;
-
-    double scaledWidth = (double) width() / (double) _videoWidth;
-    double scaledHeight = (double) height() / (double) _videoHeight;
-
-    if (scaledWidth < scaledHeight) {
-        double modHeight = ((double) _videoHeight * (double) width()) / (double) _videoWidth;
-        double totalHeight = (double) modHeight / (double) height();
-
-        for (int i = 0; i < 6; i++) {
-            // vertex position
-            vertData.append(coords[i][0]);
-            vertData.append(coords[i][1] * totalHeight);
-            vertData.append(coords[i][2]);
-            // texture coordinate
-            vertData.append(coords[i][0] > 0 ? 1 : 0);
-            vertData.append(coords[i][1] > 0 ? 0 : 1);
-        }
-    } else if (scaledWidth > scaledHeight) {
-        double modWidth = ((double) _videoWidth * (double) height()) / (double) _videoHeight;
-        double totalWidth = (double) modWidth / (double) width();
-
-        for (int i = 0; i < 6; i++) {
-            // vertex position
-            vertData.append(coords[i][0] * totalWidth);
-            vertData.append(coords[i][1]);
-            vertData.append(coords[i][2]);
-            // texture coordinate
-            vertData.append(coords[i][0] > 0 ? 1 : 0);
-            vertData.append(coords[i][1] > 0 ? 0 : 1);
-        }
-    } else {
-        for (int i = 0; i < 6; i++) {
-            // vertex position
-            vertData.append(coords[i][0]);
-            vertData.append(coords[i][1]);
-            vertData.append(coords[i][2]);
-            // texture coordinate
-            vertData.append(coords[i][0] > 0 ? 1 : 0);
-            vertData.append(coords[i][1] > 0 ? 0 : 1);
-        }
-    }
-
-    // new
-    if (! vbo.isCreated()) {
-        vbo.create();
+    _renderer.resize(qRound(width * devicePixelRatioF()), qRound(height * devicePixelRatioF()));
+    if (_pipeline) {
+        _pipeline->targetSize(qRound(width * devicePixelRatioF()), qRound(height * devicePixelRatioF()));
     }
-
-    vbo.bind();
-    vbo.allocate(vertData.constData(), vertData.count() * sizeof(GLfloat));
 }
 
 void VideoPlayer::videoSize(int width, int height) {
-    _videoWidth = width;
-    _videoHeight = height;
-
-    makeCurrent();
-    makeObject();
-    doneCurrent();
+    _renderer.videoSize(width, height);
+    update();
 }
 
-void VideoPlayer::newFrame (GLuint texture) {
-    textureId = texture;
+// called on the streaming thread
+void VideoPlayer::newFrame (const VideoFrame& frame) {
+    _renderer.frame(frame);
 
-    update();
+    QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
 }
 
 void VideoPlayer::initPipeline() {
     if (! _pipeline) {
+        GstreamerPipeline::waitForGstreamer();
+
         _pipeline = std::unique_ptr<GstreamerPipeline>(new GstreamerPipeline());
         _pipeline->initialize(context());
+        _pipeline->targetSize(qRound(width() * devicePixelRatioF()), qRound(height() * devicePixelRatioF()));
         connect(_pipeline.get(), &GstreamerPipeline::newFrameReady, this, &VideoPlayer::newFrame, Qt::DirectConnection);
         connect(_pipeline.get(), &GstreamerPipeline::videoSize, this, &VideoPlayer::videoSize);
         connect(_pipeline.get(), &GstreamerPipeline::finished, this, &VideoPlayer::finished);
+        connect(_pipeline.get(), &GstreamerPipeline::durationChanged, this, &VideoPlayer::duration);
+
+        StartupProfile::mark("pipeline");
     }
 }
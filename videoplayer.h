@@ -41,35 +41,36 @@
 #ifndef VIDEOPLAYER_H
 #define VIDEOPLAYER_H
 
+#include "gpustats.h"
 #include "gstpipeline.h"
+#include "videorenderer.h"
 
 #include <QOpenGLWidget>
-#include <QOpenGLFunctions>
-#include <QOpenGLBuffer>
-
-#include <QOpenGLShaderProgram>
-#include <QOpenGLTexture>
 
 #include <memory>
 
-class VideoPlayer : public QOpenGLWidget, protected QOpenGLFunctions {
+class VideoPlayer : public QOpenGLWidget {
     Q_OBJECT
 
 public:
     explicit VideoPlayer(QWidget *parent = 0);
     ~VideoPlayer();
 
-    void open(const QString& filename);
+    void open(const QString& filename, quint64 startTime = GST_CLOCK_TIME_NONE);
     void stop();
+    void resetPipeline();
 
     QSize minimumSizeHint() const override;
     QSize sizeHint() const override;
     void setClearColor(const QColor &color);
+    void poster(const QImage& image);
 signals:
     void finished();
+    void framePresented();
+    void duration(qint64 millis);
 
 public slots:
-    void newFrame(GLuint texture);
+    void newFrame(const VideoFrame& frame);
     void initPipeline();
 
 protected:
@@ -78,18 +79,11 @@ protected:
     void resizeGL(int width, int height) override;
 
 private:
-    void makeObject();
-
-    int _videoWidth = 1024;
-    int _videoHeight = 1024;
-
     std::unique_ptr<GstreamerPipeline> _pipeline;
-    QColor clearColor;
-    QPoint lastPos;
-    std::unique_ptr<QOpenGLShaderProgram> program;
-    QOpenGLBuffer vbo;
-    QMatrix4x4 matrix;
-    GLuint textureId = 0;
+    VideoRenderer _renderer;
+    GpuFrameTimer _frameTimer;
+    QString _pendingFile;
+    quint64 _pendingStartTime = GST_CLOCK_TIME_NONE;
 
 private slots:
     void videoSize(int width, int height);
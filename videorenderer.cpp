@@ -0,0 +1,343 @@
+#include "videorenderer.h"
+#include "shadercache.h"
+#include "trace.h"
+
+#include <QOpenGLContext>
+#include <QVector2D>
+#include <QVector3D>
+
+#define PROGRAM_VERTEX_ATTRIBUTE 0
+#define PROGRAM_TEXCOORD_ATTRIBUTE 1
+
+#ifndef GL_TIMEOUT_IGNORED
+#define GL_TIMEOUT_IGNORED 0xFFFFFFFFFFFFFFFFull
+#endif
+
+static const char* vertexSource =
+        "attribute highp vec4 vertex;\n"
+        "attribute mediump vec4 texCoord;\n"
+        "varying mediump vec4 texc;\n"
+        "uniform mediump mat4 matrix;\n"
+        "void main(void)\n"
+        "{\n"
+        "    gl_Position = matrix * vertex;\n"
+        "    texc = texCoord;\n"
+        "}\n";
+
+// Comes ahead of every fragment shader. A plane's texture may be padded
+// past the video's width and height, scale maps the video onto the part
+// that holds it. Video the decoder couldn't scale to the screen is scaled
+// down here: four bilinear taps spread over a pixel's footprint average up
+// to 4x4 texels, where a single tap would skip most of them.
+static const char* fetchSource =
+        "uniform mediump vec2 tap;\n"
+        "mediump vec4 fetch(sampler2D plane, mediump vec2 scale, mediump vec2 st)\n"
+        "{\n"
+        "#ifdef DOWNSAMPLE\n"
+        "    mediump vec2 offset = tap * scale;\n"
+        "    st *= scale;\n"
+        "    return 0.25 * (texture2D(plane, st - offset) + texture2D(plane, st + vec2(offset.x, -offset.y)) +\n"
+        "                   texture2D(plane, st + vec2(-offset.x, offset.y)) + texture2D(plane, st + offset));\n"
+        "#else\n"
+        "    return texture2D(plane, st * scale);\n"
+        "#endif\n"
+        "}\n";
+
+// one fragment shader per VideoFrame::Format, in the same order
+static const char* rgbaFragment =
+        "uniform sampler2D plane0;\n"
+        "uniform mediump vec2 scale0;\n"
+        "varying mediump vec4 texc;\n"
+        "void main(void)\n"
+        "{\n"
+        "    gl_FragColor = fetch(plane0, scale0, texc.st);\n"
+        "}\n";
+
+static const char* nv12Fragment =
+        "uniform sampler2D plane0;\n"
+        "uniform sampler2D plane1;\n"
+        "uniform mediump vec2 scale0;\n"
+        "uniform mediump vec2 scale1;\n"
+        "uniform mediump mat3 yuvMatrix;\n"
+        "uniform mediump vec3 yuvOffset;\n"
+        "varying mediump vec4 texc;\n"
+        "void main(void)\n"
+        "{\n"
+        "    mediump vec3 yuv = vec3(fetch(plane0, scale0, texc.st).r, fetch(plane1, scale1, texc.st).UV);\n"
+        "    gl_FragColor = vec4(yuvMatrix * (yuv - yuvOffset), 1.0);\n"
+        "}\n";
+
+static const char* i420Fragment =
+        "uniform sampler2D plane0;\n"
+        "uniform sampler2D plane1;\n"
+        "uniform sampler2D plane2;\n"
+        "uniform mediump vec2 scale0;\n"
+        "uniform mediump vec2 scale1;\n"
+        "uniform mediump vec2 scale2;\n"
+        "uniform mediump mat3 yuvMatrix;\n"
+        "uniform mediump vec3 yuvOffset;\n"
+        "varying mediump vec4 texc;\n"
+        "void main(void)\n"
+        "{\n"
+        "    mediump vec3 yuv = vec3(fetch(plane0, scale0, texc.st).r, fetch(plane1, scale1, texc.st).r, fetch(plane2, scale2, texc.st).r);\n"
+        "    gl_FragColor = vec4(yuvMatrix * (yuv - yuvOffset), 1.0);\n"
+        "}\n";
+
+// Y'CbCr to R'G'B' for the frame's luma coefficients, studio range
+// expansion is folded into the matrix
+static void yuvToRgb(const VideoFrame& frame, QMatrix3x3* matrix, QVector3D* offset) {
+    float kr = frame.kr;
+    float kb = frame.kb;
+    float kg = 1.0f - kr - kb;
+    float ys = frame.fullRange ? 1.0f : 255.0f / 219.0f;
+    float cs = frame.fullRange ? 1.0f : 255.0f / 224.0f;
+
+    const float values[] = {
+        ys, 0.0f,                              2.0f * (1.0f - kr) * cs,
+        ys, -2.0f * kb * (1.0f - kb) / kg * cs, -2.0f * kr * (1.0f - kr) / kg * cs,
+        ys, 2.0f * (1.0f - kb) * cs,           0.0f
+    };
+    *matrix = QMatrix3x3(values);
+    *offset = QVector3D(frame.fullRange ? 0.0f : 16.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f);
+}
+
+VideoRenderer::VideoRenderer() : _posterTexture(QOpenGLTexture::Target2D) {
+    _posterTexture.setAutoMipMapGenerationEnabled(false);
+}
+
+void VideoRenderer::initialize(QOpenGLContext *context) {
+    initializeOpenGLFunctions();
+
+    // core in GL 3.2 and GLES 3, GStreamer only places fences where it exists
+    _waitSync = reinterpret_cast<WaitSync>(context->getProcAddress("glWaitSync"));
+
+    // GL without RG textures gets NV12 chroma as luminance/alpha
+    QSurfaceFormat surface = context->format();
+    bool rgTextures = context->isOpenGLES()
+            ? surface.majorVersion() >= 3 || context->hasExtension("GL_EXT_texture_rg")
+            : surface.version() >= qMakePair(3, 0) || context->hasExtension("GL_ARB_texture_rg");
+    QByteArray nv12Source = QByteArray(nv12Fragment).replace("UV", rgTextures ? "rg" : "ra");
+
+    ShaderCache shaderCache(context);
+    const char* fragmentSources[] = {rgbaFragment, nv12Source.constData(), i420Fragment};
+    for (int downsample = 0; downsample < 2; downsample++) {
+        for (int i = 0; i < 3; i++) {
+            QByteArray fragmentSource = QByteArray(downsample ? "#define DOWNSAMPLE\n" : "") + fetchSource + fragmentSources[i];
+            auto& program = _programs[downsample][i];
+            program = std::unique_ptr<QOpenGLShaderProgram>(new QOpenGLShaderProgram);
+            program->bindAttributeLocation("vertex", PROGRAM_VERTEX_ATTRIBUTE);
+            program->bindAttributeLocation("texCoord", PROGRAM_TEXCOORD_ATTRIBUTE);
+            shaderCache.link(*program, vertexSource, fragmentSource.constData());
+
+            program->bind();
+            program->setUniformValue("plane0", 0);
+            program->setUniformValue("plane1", 1);
+            program->setUniformValue("plane2", 2);
+        }
+    }
+
+    _geometryChanged = true;
+}
+
+void VideoRenderer::cleanup() {
+    clear();
+    for (auto& programs : _programs) {
+        for (auto& program : programs) {
+            program.reset();
+        }
+    }
+    _posterTexture.destroy();
+    _vbo.destroy();
+}
+
+// called on the GUI thread when a file is opened, frame() may run
+// concurrently on the streaming thread
+void VideoRenderer::generation(int generation) {
+    QMutexLocker lock(&_mutex);
+    _generation = generation;
+    _nextFrame = VideoFrame();
+    _liveSize = false;
+}
+
+// called on the streaming thread
+void VideoRenderer::frame(const VideoFrame &frame) {
+    QMutexLocker lock(&_mutex);
+    // still in flight from the file before
+    if (frame.generation < _generation) {
+        return;
+    }
+    _nextFrame = frame;
+    _showPoster = false;
+}
+
+void VideoRenderer::videoSize(int width, int height) {
+    QMutexLocker lock(&_mutex);
+    _videoWidth = width;
+    _videoHeight = height;
+    _liveSize = true;
+    _geometryChanged = true;
+}
+
+void VideoRenderer::poster(const QImage &image) {
+    QMutexLocker lock(&_mutex);
+    // the live decode got there first
+    if (_nextFrame.isValid() || image.isNull()) {
+        return;
+    }
+
+    _nextPoster = image;
+    _posterChanged = true;
+    _showPoster = true;
+    // the decoder's size is exact, the poster's was scaled and rounded
+    if (! _liveSize) {
+        _videoWidth = image.width();
+        _videoHeight = image.height();
+        _geometryChanged = true;
+    }
+}
+
+void VideoRenderer::clearColor(const QColor &color) {
+    _clearColor = color;
+}
+
+void VideoRenderer::clear() {
+    QMutexLocker lock(&_mutex);
+    _frame = VideoFrame();
+    _nextFrame = VideoFrame();
+    _showPoster = false;
+    _liveSize = false;
+    // a new pipeline counts its generations from the start again
+    _generation = 0;
+}
+
+void VideoRenderer::resize(int width, int height) {
+    QMutexLocker lock(&_mutex);
+    _width = qMax(width, 1);
+    _height = qMax(height, 1);
+    _geometryChanged = true;
+}
+
+bool VideoRenderer::render() {
+    TRACE_SPAN("VideoRenderer::render");
+
+    glClearColor(_clearColor.redF(), _clearColor.greenF(), _clearColor.blueF(), _clearColor.alphaF());
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // a local reference keeps the frame mapped should clear() drop it meanwhile
+    VideoFrame frame;
+    QImage poster;
+    bool posterChanged;
+    bool showPoster;
+    bool decoded = false;
+    bool downsample;
+    QVector2D tap;
+    {
+        QMutexLocker lock(&_mutex);
+        if (_nextFrame.isValid()) {
+            _frame = _nextFrame;
+            _nextFrame = VideoFrame();
+            decoded = true;
+        }
+        frame = _frame;
+        posterChanged = _posterChanged;
+        _posterChanged = false;
+        poster.swap(_nextPoster);
+        showPoster = _showPoster;
+        if (_geometryChanged) {
+            _geometryChanged = false;
+            _makeObject();
+        }
+        downsample = _downsample;
+        tap = _tap;
+    }
+
+    if (posterChanged) {
+        _posterTexture.destroy();
+        _posterTexture.setData(poster);
+    }
+
+    showPoster = showPoster && _posterTexture.isCreated();
+    if (showPoster) {
+        frame = VideoFrame();
+        frame.textures[0] = _posterTexture.textureId();
+    } else if (frame.sync != nullptr && _waitSync != nullptr) {
+        // queue a GPU side wait for the decoder's writes, the CPU goes on
+        _waitSync(frame.sync, 0, GL_TIMEOUT_IGNORED);
+    }
+
+    auto& program = _programs[downsample ? 1 : 0][static_cast<int>(frame.format)];
+    program->bind();
+    program->setUniformValue("matrix", _matrix);
+    if (downsample) {
+        program->setUniformValue("tap", tap);
+    }
+    _vbo.bind();
+    program->enableAttributeArray(PROGRAM_VERTEX_ATTRIBUTE);
+    program->enableAttributeArray(PROGRAM_TEXCOORD_ATTRIBUTE);
+    program->setAttributeBuffer(PROGRAM_VERTEX_ATTRIBUTE, GL_FLOAT, 0, 3, 5 * sizeof(GLfloat));
+    program->setAttributeBuffer(PROGRAM_TEXCOORD_ATTRIBUTE, GL_FLOAT, 3 * sizeof(GLfloat), 2, 5 * sizeof(GLfloat));
+
+    if (frame.format != VideoFrame::Format::RGBA) {
+        QMatrix3x3 yuvMatrix;
+        QVector3D yuvOffset;
+        yuvToRgb(frame, &yuvMatrix, &yuvOffset);
+        program->setUniformValue("yuvMatrix", yuvMatrix);
+        program->setUniformValue("yuvOffset", yuvOffset);
+    }
+
+    static const char* scaleNames[] = {"scale0", "scale1", "scale2"};
+    for (int plane = 2; plane >= 0; plane--) {
+        program->setUniformValue(scaleNames[plane], QVector2D(frame.texScale[plane][0], frame.texScale[plane][1]));
+        glActiveTexture(GL_TEXTURE0 + plane);
+        glBindTexture (GL_TEXTURE_2D, frame.textures[plane]);
+    }
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    return decoded && ! showPoster;
+}
+
+// called with _mutex held
+void VideoRenderer::_makeObject() {
+    static const GLfloat coords[6][3] =
+        { { -1.0f, -1.0f,  0.0f },
+          {  1.0f, -1.0f,  0.0f },
+          { -1.0f,  1.0f,  0.0f },
+          { -1.0f,  1.0f,  0.0f },
+          {  1.0f,  1.0f,  0.0f },
+          {  1.0f, -1.0f,  0.0f } };
+
+    // shrink one axis so the video keeps its aspect ratio
+    double scaleX = 1.0;
+    double scaleY = 1.0;
+    double scaledWidth = (double) _width / (double) _videoWidth;
+    double scaledHeight = (double) _height / (double) _videoHeight;
+    if (scaledWidth < scaledHeight) {
+        scaleY = ((double) _videoHeight * (double) _width) / (double) _videoWidth / (double) _height;
+    } else if (scaledWidth > scaledHeight) {
+        scaleX = ((double) _videoWidth * (double) _height) / (double) _videoHeight / (double) _width;
+    }
+
+    // a quarter pixel away from the centre, in texture coordinates
+    double drawnWidth = _width * scaleX;
+    double drawnHeight = _height * scaleY;
+    _downsample = _videoWidth > drawnWidth + 0.5 || _videoHeight > drawnHeight + 0.5;
+    _tap = QVector2D(0.25 / drawnWidth, 0.25 / drawnHeight);
+
+    QVector<GLfloat> vertData;
+    for (int i = 0; i < 6; i++) {
+        // vertex position
+        vertData.append(coords[i][0] * scaleX);
+        vertData.append(coords[i][1] * scaleY);
+        vertData.append(coords[i][2]);
+        // texture coordinate
+        vertData.append(coords[i][0] > 0 ? 1 : 0);
+        vertData.append(coords[i][1] > 0 ? 0 : 1);
+    }
+
+    if (! _vbo.isCreated()) {
+        _vbo.create();
+    }
+
+    _vbo.bind();
+    _vbo.allocate(vertData.constData(), vertData.count() * sizeof(GLfloat));
+}
@@ -0,0 +1,76 @@
+#ifndef VIDEORENDERER_H
+#define VIDEORENDERER_H
+
+#include "videoframe.h"
+
+#include <QColor>
+#include <QImage>
+#include <QMatrix4x4>
+#include <QVector2D>
+#include <QMutex>
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+
+#include <memory>
+
+class QOpenGLContext;
+
+// Draws the frames of a GstreamerPipeline letterboxed into the current
+// context. frame(), poster() and videoSize() may be called from any
+// thread, the rest only with the renderer's context current.
+class VideoRenderer : protected QOpenGLFunctions {
+public:
+    VideoRenderer();
+
+    void initialize(QOpenGLContext* context);
+    void cleanup();
+
+    // frames of an older generation are dropped
+    void generation(int generation);
+    void frame(const VideoFrame& frame);
+    void videoSize(int width, int height);
+    // drawn instead of the current frame until the next one is decoded
+    void poster(const QImage& image);
+    void clearColor(const QColor& color);
+    void clear();
+
+    // in device pixels, video larger than that is scaled down when drawn
+    void resize(int width, int height);
+    // returns true when a newly decoded frame was drawn, a poster or a
+    // repaint of the last frame doesn't count
+    bool render();
+
+private:
+    typedef void (QOPENGLF_APIENTRYP WaitSync)(void* sync, GLbitfield flags, quint64 timeout);
+
+    QMutex _mutex;
+    VideoFrame _frame;
+    VideoFrame _nextFrame;
+    int _generation = 0;
+    int _videoWidth = 1024;
+    int _videoHeight = 1024;
+    // set by videoSize() for the current generation, the poster's size then no longer applies
+    bool _liveSize = false;
+    bool _geometryChanged = true;
+    QImage _nextPoster;
+    bool _posterChanged = false;
+    bool _showPoster = false;
+
+    int _width = 1;
+    int _height = 1;
+    QColor _clearColor = Qt::black;
+    // indexed by downsampling, then by VideoFrame::Format
+    std::unique_ptr<QOpenGLShaderProgram> _programs[2][3];
+    QOpenGLBuffer _vbo;
+    QOpenGLTexture _posterTexture;
+    QMatrix4x4 _matrix;
+    bool _downsample = false;
+    QVector2D _tap;
+    WaitSync _waitSync = nullptr;
+
+    void _makeObject();
+};
+
+#endif // VIDEORENDERER_H
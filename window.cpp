@@ -39,35 +39,69 @@
 ****************************************************************************/
 
 #include "window.h"
+#include "logger.h"
+#include "mediacache.h"
+#include "metrics.h"
+#include "startupprofile.h"
+#include "syncclock.h"
+#include "trace.h"
 
 #include <QtWidgets>
 #include <QTimer>
 
-DisupureiWindow::DisupureiWindow() : QOpenGLWidget() {
-    _layout.addWidget(&_videoPlayer);
-    _layout.addWidget(&_imagePlayer);
+DisupureiWindow::DisupureiWindow() : QWidget() {
+    createPlayers();
     setLayout(&_layout);
 
     setCursor(Qt::BlankCursor);
     setWindowTitle(tr("disupurei"));
     _timer.setSingleShot(true);
+    _startTimer.setSingleShot(true);
+    _startTimer.setTimerType(Qt::PreciseTimer);
 
     connect(&_timer, &QTimer::timeout, this, &DisupureiWindow::onEntryFinished);
-    connect(&_videoPlayer, &VideoPlayer::finished, this, &DisupureiWindow::onEntryFinished);
-    connect(&_imagePlayer, &ImagePlayer::timeout, this, &DisupureiWindow::onEntryFinished);
+    connect(&_startTimer, &QTimer::timeout, this, &DisupureiWindow::onEntryStart);
+    connect(&_supervisor, &PlaybackSupervisor::skipRequested, this, &DisupureiWindow::onSkipRequested);
+    connect(&_supervisor, &PlaybackSupervisor::rebuildPipelineRequested, this, &DisupureiWindow::onRebuildPipeline);
+    connect(&_supervisor, &PlaybackSupervisor::recreatePlayersRequested, this, &DisupureiWindow::onRecreatePlayers);
     connect(&_playlist, &Playlist::playlistAvailable, this, &DisupureiWindow::onPlaylistAvailable);
+    connect(&_playlist, &Playlist::playlistUpdated, this, &DisupureiWindow::onPlaylistUpdated);
+    connect(&_playlist, &Playlist::playlistEmptied, this, &DisupureiWindow::onPlaylistEmptied);
+    connect(&_playlist, &Playlist::videoCached, &_posters, &PosterExtractor::extract);
 
     // the Gst Pipeline needs to be initialized after we have a window opened
-    connect(this, &DisupureiWindow::windowOpened, &_videoPlayer, &VideoPlayer::initPipeline, Qt::QueuedConnection);
-    connect(this, &DisupureiWindow::windowOpened, this, [this] {
-        _playlist.checkForCachedMetadata();
-    }, Qt::QueuedConnection);
+    connect(this, &DisupureiWindow::windowOpened, this, &DisupureiWindow::onWindowOpened, Qt::QueuedConnection);
+}
+
+void DisupureiWindow::createPlayers() {
+    _surface = std::unique_ptr<PlaybackSurface>(PlaybackSurface::create());
+    _layout.addWidget(_surface.get());
+
+    connect(_surface.get(), &PlaybackSurface::finished, this, &DisupureiWindow::onEntryFinished);
+    connect(_surface.get(), &PlaybackSurface::framePresented, this, &DisupureiWindow::onFramePresented);
+    connect(_surface.get(), &PlaybackSurface::duration, &_supervisor, &PlaybackSupervisor::videoDuration);
 }
 
 Playlist &DisupureiWindow::playlist() {
     return _playlist;
 }
 
+Prefetcher &DisupureiWindow::prefetcher() {
+    return _prefetcher;
+}
+
+PlaybackSupervisor &DisupureiWindow::supervisor() {
+    return _supervisor;
+}
+
+void DisupureiWindow::fastBoot(bool enabled) {
+    _fastBoot = enabled;
+    _playlist.preferImageStart(enabled);
+    if (enabled) {
+        _playlist.readCachedMetadataAsync();
+    }
+}
+
 void DisupureiWindow::keyReleaseEvent(QKeyEvent *event) {
     switch (event->key()) {
     case Qt::Key_Escape:
@@ -77,7 +111,7 @@ void DisupureiWindow::keyReleaseEvent(QKeyEvent *event) {
         setWindowState(windowState() ^ Qt::WindowFullScreen);
         break;
     default:
-        QOpenGLWidget::keyReleaseEvent(event);
+        QWidget::keyReleaseEvent(event);
     }
 }
 
@@ -87,27 +121,158 @@ void DisupureiWindow::showEvent(QShowEvent *event) {
     emit windowOpened();
 }
 
+void DisupureiWindow::onWindowOpened() {
+    if (_fastBoot) {
+        // put cached content on screen first, the pipeline waits for gst_init to complete
+        _playlist.checkForCachedMetadata();
+        if (_playlist.isEmpty()) {
+            _surface->initPipeline();
+        }
+    } else {
+        _surface->initPipeline();
+        _playlist.checkForCachedMetadata();
+    }
+}
+
+void DisupureiWindow::onRebuildPipeline() {
+    _surface->resetPipeline();
+}
+
+void DisupureiWindow::onRecreatePlayers() {
+    _layout.removeWidget(_surface.get());
+    _surface.reset();
+
+    createPlayers();
+}
+
+void DisupureiWindow::onFramePresented() {
+    static auto& framesPresented = Metrics::counter("disupurei_frames_presented_total", "Frames drawn by the image and video players");
+    static auto& transitionGap = Metrics::histogram("disupurei_transition_gap_seconds", "Time from starting an entry until its first frame is drawn",
+                                                    {0.016, 0.033, 0.05, 0.1, 0.25, 0.5, 1, 2.5});
+
+    framesPresented.add();
+    _supervisor.framePresented();
+    if (_awaitingEntryFrame) {
+        _awaitingEntryFrame = false;
+        transitionGap.observe(_entryClock.elapsed() / 1000.0);
+        Trace::asyncEnd("transition", _transition);
+
+        if (SyncClock::enabled() && GST_CLOCK_TIME_IS_VALID(_scheduledStart)) {
+            static auto& startError = Metrics::histogram("disupurei_sync_start_error_seconds", "Time from the scheduled start of an entry until its first frame is drawn",
+                                                         {0.001, 0.004, 0.008, 0.016, 0.033, 0.1, 0.5});
+            GstClockTime now = SyncClock::now();
+            startError.observe(now > _scheduledStart ? (double) (now - _scheduledStart) / GST_SECOND : 0);
+        }
+    }
+
+    emit framePresented();
+
+    if (_firstFramePresented) {
+        return;
+    }
+
+    _firstFramePresented = true;
+    StartupProfile::finish();
+
+    if (_fastBoot) {
+        QTimer::singleShot(0, _surface.get(), &PlaybackSurface::initPipeline);
+    }
+}
+
 void DisupureiWindow::onEntryFinished() {
-    const Entry& entry = _playlist.next();
-    qDebug() << "Playing back" << entry.fileId << "(" << entry.type << ")";
+    // a player stopped along with an emptied sequence may still report its end
+    if (_playlist.isEmpty()) {
+        return;
+    }
+
+    if (_awaitingEntryFrame) {
+        Trace::asyncEnd("transition", _transition);
+        _awaitingEntryFrame = false;
+    }
+    Trace::asyncBegin("transition", ++_transition);
+
+    _scheduledEntry = _playlist.next();
+    qCInfo(lcPlayer) << "Playing back" << _scheduledEntry.fileId << "(" << _scheduledEntry.type << ")";
+
+    // in sync mode entries start on the next shared boundary, a video is
+    // prerolled right away and holds its first frame until then
+    _scheduledStart = SyncClock::nextBoundary();
+    if (_scheduledEntry.type == Playlist::Type::VIDEO) {
+        _surface->openVideo(_scheduledEntry.filePath, _scheduledStart);
+    }
+
+    qint64 delay = SyncClock::millisUntil(_scheduledStart);
+    if (delay > 0) {
+        _startTimer.start(delay);
+    } else {
+        _startTimer.stop();
+        onEntryStart();
+    }
+
+    if (_prefetcher.depth() > 0) {
+        _prefetcher.prefetch(_playlist.upcoming(_prefetcher.depth()));
+    }
+}
+
+// the stalled player must not finish later and cut the next entry short
+void DisupureiWindow::onSkipRequested() {
+    _surface->stop();
 
+    onEntryFinished();
+}
+
+void DisupureiWindow::onEntryStart() {
+    static auto& entriesStarted = Metrics::counter("disupurei_entries_started_total", "Playlist entries started");
+    static auto& postersShown = Metrics::counter("disupurei_video_posters_shown_total", "Videos started on their poster frame");
+
+    const Entry& entry = _scheduledEntry;
     switch (entry.type) {
     case Playlist::Type::IMAGE:
-        _layout.setCurrentWidget(&_imagePlayer);
-        _imagePlayer.open(entry.filePath, entry.durationMillis);
+        _surface->showImage(entry.filePath, entry.durationMillis, _prefetcher.takeImage(entry.filePath));
         break;
-    case Playlist::Type::VIDEO:
-        _layout.setCurrentWidget(&_videoPlayer);
-        _videoPlayer.open(entry.filePath);
+    case Playlist::Type::VIDEO: {
+        QString posterPath = MediaCache::posterPath(entry.filePath);
+        QImage poster = _prefetcher.takeImage(posterPath);
+        if (poster.isNull() && QFile::exists(posterPath)) {
+            poster = QImage(posterPath);
+        }
+        if (! poster.isNull()) {
+            postersShown.add();
+        }
+        _surface->showVideo(poster);
         break;
     }
+    }
+    entriesStarted.add();
+    _supervisor.entryStarted(entry);
+    _awaitingEntryFrame = true;
+    _entryClock.start();
+    emit entryStarted(entry);
 }
 
 void DisupureiWindow::onPlaylistAvailable() {
-    qDebug() << Q_FUNC_INFO;
+    qCDebug(lcPlayer) << Q_FUNC_INFO;
 
-    _videoPlayer.stop();
-    _imagePlayer.stop();
+    _surface->stop();
 
     onEntryFinished();
 }
+
+// the playing entry is left alone, only what comes next may have changed
+void DisupureiWindow::onPlaylistUpdated() {
+    qCDebug(lcPlayer) << Q_FUNC_INFO;
+
+    if (_prefetcher.depth() > 0) {
+        _prefetcher.prefetch(_playlist.upcoming(_prefetcher.depth()));
+    }
+}
+
+// the last picture stays up until a sequence has entries again
+void DisupureiWindow::onPlaylistEmptied() {
+    qCDebug(lcPlayer) << Q_FUNC_INFO;
+
+    _timer.stop();
+    _startTimer.stop();
+    _supervisor.stop();
+    _surface->stop();
+}
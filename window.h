@@ -41,24 +41,35 @@
 #ifndef WINDOW_H
 #define WINDOW_H
 
-#include "videoplayer.h"
-#include "imageplayer.h"
+#include "playbacksurface.h"
 #include "playlist.h"
+#include "posterextractor.h"
+#include "prefetcher.h"
+#include "supervisor.h"
 
-#include <QOpenGLWidget>
+#include <QWidget>
 #include <QStackedLayout>
+#include <QElapsedTimer>
+
+#include <memory>
 
 class GLWidget;
 
-class DisupureiWindow : public QOpenGLWidget {
+class DisupureiWindow : public QWidget {
     Q_OBJECT
 
 public:
     DisupureiWindow();
     Playlist& playlist();
+    Prefetcher& prefetcher();
+    PlaybackSupervisor& supervisor();
+
+    void fastBoot(bool enabled);
 
 signals:
     void windowOpened();
+    void entryStarted(const Entry& entry);
+    void framePresented();
 
 protected:
     void keyReleaseEvent(QKeyEvent* event);
@@ -66,15 +77,34 @@ protected:
 
 private:
     QTimer _timer;
+    QTimer _startTimer;
     Playlist _playlist;
-    VideoPlayer _videoPlayer;
-    ImagePlayer _imagePlayer;
+    Prefetcher _prefetcher;
+    PosterExtractor _posters;
+    PlaybackSupervisor _supervisor;
+    std::unique_ptr<PlaybackSurface> _surface;
     QStackedLayout _layout;
+    bool _fastBoot = false;
+    bool _firstFramePresented = false;
+    bool _awaitingEntryFrame = false;
+    quint64 _transition = 0;
+    QElapsedTimer _entryClock;
+    Entry _scheduledEntry;
+    quint64 _scheduledStart = 0;
 
     void playEntry();
+    void createPlayers();
 private slots:
+    void onWindowOpened();
+    void onFramePresented();
     void onEntryFinished();
+    void onSkipRequested();
+    void onEntryStart();
     void onPlaylistAvailable();
+    void onPlaylistUpdated();
+    void onPlaylistEmptied();
+    void onRebuildPipeline();
+    void onRecreatePlayers();
 };
 
 #endif
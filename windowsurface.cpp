@@ -0,0 +1,122 @@
+#include "windowsurface.h"
+#include "startupprofile.h"
+
+#include <QGuiApplication>
+#include <QOpenGLContext>
+
+bool WindowSurface::isSupported(bool threaded) {
+    return (! threaded || QOpenGLContext::supportsThreadedOpenGL()) &&
+            QGuiApplication::platformName() != QLatin1String("eglfs");
+}
+
+WindowSurface::WindowSurface(bool threaded, QWidget *parent) : PlaybackSurface(parent), _window(new RenderWindow(threaded)) {
+    _window->setCursor(Qt::BlankCursor);
+    QWidget* container = QWidget::createWindowContainer(_window, this);
+    container->setFocusPolicy(Qt::NoFocus);
+    _layout.addWidget(container);
+    setLayout(&_layout);
+
+    connect(&_window->loop(), &RenderLoop::initialized, this, &WindowSurface::onRenderInitialized);
+    connect(&_window->loop(), &RenderLoop::framePresented, this, &PlaybackSurface::framePresented);
+    connect(&_window->loop(), &RenderLoop::imageFinished, this, &PlaybackSurface::finished);
+}
+
+WindowSurface::~WindowSurface() {
+    // no more frames for the renderer before the window goes
+    _pipeline.reset();
+}
+
+void WindowSurface::initPipeline() {
+    // the pipeline shares the window's context, which exists once the window is exposed
+    QOpenGLContext* context = _window->loop().context();
+    if (context == nullptr) {
+        _pipelineRequested = true;
+        return;
+    }
+
+    if (! _pipeline) {
+        GstreamerPipeline::waitForGstreamer();
+
+        _pipeline = std::unique_ptr<GstreamerPipeline>(new GstreamerPipeline());
+        _pipeline->initialize(context);
+        _pipeline->targetSize(qRound(width() * devicePixelRatioF()), qRound(height() * devicePixelRatioF()));
+        connect(_pipeline.get(), &GstreamerPipeline::newFrameReady, this, &WindowSurface::newFrame, Qt::DirectConnection);
+        connect(_pipeline.get(), &GstreamerPipeline::videoSize, this, &WindowSurface::videoSize);
+        connect(_pipeline.get(), &GstreamerPipeline::finished, this, &PlaybackSurface::finished);
+        connect(_pipeline.get(), &GstreamerPipeline::durationChanged, this, &PlaybackSurface::duration);
+
+        StartupProfile::mark("pipeline");
+    }
+}
+
+void WindowSurface::resetPipeline() {
+    _pipeline.reset();
+    _window->loop().video().clear();
+    if (_window->loop().context() != nullptr) {
+        initPipeline();
+    }
+}
+
+void WindowSurface::openVideo(const QString &filename, quint64 startTime) {
+    if (_window->loop().context() == nullptr) {
+        _pendingFile = filename;
+        _pendingStartTime = startTime;
+        return;
+    }
+
+    if (! _pipeline) {
+        initPipeline();
+    }
+
+    _window->loop().video().generation(_pipeline->open(filename, startTime));
+}
+
+void WindowSurface::showVideo(const QImage &poster) {
+    _window->loop().video().poster(poster);
+    _window->loop().showVideo();
+}
+
+void WindowSurface::showImage(const QString &filename, int duration, const QImage &image) {
+    _window->loop().showImage(filename, duration, image);
+}
+
+void WindowSurface::stop() {
+    _pendingFile.clear();
+    if (_pipeline) {
+        _pipeline->stop();
+    }
+}
+
+void WindowSurface::resizeEvent(QResizeEvent *event) {
+    PlaybackSurface::resizeEvent(event);
+
+    if (_pipeline) {
+        _pipeline->targetSize(qRound(width() * devicePixelRatioF()), qRound(height() * devicePixelRatioF()));
+    }
+}
+
+// called on the streaming thread
+void WindowSurface::newFrame(const VideoFrame &frame) {
+    _window->loop().video().frame(frame);
+    _window->loop().requestRender();
+}
+
+void WindowSurface::videoSize(int width, int height) {
+    _window->loop().video().videoSize(width, height);
+    _window->loop().requestRender();
+}
+
+void WindowSurface::onRenderInitialized() {
+    StartupProfile::mark("render context");
+
+    if (_pipelineRequested) {
+        _pipelineRequested = false;
+        initPipeline();
+    }
+
+    if (! _pendingFile.isEmpty()) {
+        QString filename = _pendingFile;
+        _pendingFile.clear();
+        openVideo(filename, _pendingStartTime);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef WINDOWSURFACE_H
+#define WINDOWSURFACE_H
+
+#include "gstpipeline.h"
+#include "playbacksurface.h"
+#include "renderwindow.h"
+
+#include <QStackedLayout>
+
+#include <memory>
+
+// Plays entries on a RenderWindow embedded in the widget tree, drawn
+// straight to the window's own framebuffer. When threaded, the GUI thread
+// only opens, shows and stops; decoded frames go from the streaming thread
+// to the render thread without passing through the event loop.
+class WindowSurface : public PlaybackSurface
+{
+    Q_OBJECT
+public:
+    // needs a native child window for the container, and threaded GL for a
+    // threaded surface. Never on eglfs: its one GL window per screen is
+    // already the widget window, and it aborts on a second one.
+    static bool isSupported(bool threaded);
+
+    explicit WindowSurface(bool threaded, QWidget* parent = 0);
+    ~WindowSurface();
+
+    void initPipeline() override;
+    void resetPipeline() override;
+    void openVideo(const QString& filename, quint64 startTime) override;
+    void showVideo(const QImage& poster) override;
+    void showImage(const QString& filename, int duration, const QImage& image) override;
+    void stop() override;
+
+protected:
+    void resizeEvent(QResizeEvent* event) override;
+
+private:
+    QStackedLayout _layout;
+    // owned by its window container
+    RenderWindow* _window;
+    std::unique_ptr<GstreamerPipeline> _pipeline;
+    bool _pipelineRequested = false;
+    QString _pendingFile;
+    quint64 _pendingStartTime = GST_CLOCK_TIME_NONE;
+
+private slots:
+    void newFrame(const VideoFrame& frame);
+    void videoSize(int width, int height);
+    void onRenderInitialized();
+};
+
+#endif // WINDOWSURFACE_H